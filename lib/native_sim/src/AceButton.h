@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in for AceButton: enough for events to be published from a scripted MainTask
+namespace ace_button {
+
+class AceButton;
+
+class IEventHandler {
+    public:
+        virtual ~IEventHandler() {}
+        virtual void handleEvent(AceButton* button, uint8_t event_type, uint8_t button_state) = 0;
+};
+
+class AceButton {
+    public:
+        static const uint8_t kEventPressed = 0;
+        static const uint8_t kEventReleased = 1;
+
+        AceButton(uint8_t pin = 0, uint8_t default_released_state = 1, uint8_t id = 0) :
+                pin_(pin), id_(id) {}
+
+        uint8_t getPin() const { return pin_; }
+        uint8_t getId() const { return id_; }
+        void check() {}
+
+    private:
+        uint8_t pin_;
+        uint8_t id_;
+};
+
+}
@@ -0,0 +1,175 @@
+#include "Arduino.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "Update.h"
+#include "WiFi.h"
+#include "sim.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+UpdateClass Update;
+
+static const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+static std::atomic<uint64_t> skipped_us(0);
+static bool realtime = false;
+static void (*idle_hook)() = nullptr;
+static std::mt19937 rng(0x5317C4);
+
+namespace sim {
+
+void setRealtime(bool enabled) {
+    realtime = enabled;
+}
+
+bool isRealtime() {
+    return realtime;
+}
+
+void setIdleHook(void (*hook)()) {
+    idle_hook = hook;
+}
+
+uint64_t elapsedMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+}
+
+static uint64_t virtualMicros() {
+    return sim::elapsedMicros() + skipped_us.load(std::memory_order_relaxed);
+}
+
+uint32_t millis() {
+    return virtualMicros() / 1000;
+}
+
+uint32_t micros() {
+    return virtualMicros();
+}
+
+void delay(uint32_t ms) {
+    if (idle_hook != nullptr) {
+        idle_hook();
+    }
+    if (realtime) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    } else {
+        skipped_us.fetch_add(ms * 1000ull, std::memory_order_relaxed);
+        // Let tasks polling for the delay to end (e.g. for a prefetch) make progress
+        std::this_thread::yield();
+    }
+}
+
+void delayMicroseconds(uint32_t us) {
+    if (realtime) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    } else {
+        skipped_us.fetch_add(us, std::memory_order_relaxed);
+    }
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {}
+int digitalRead(uint8_t pin) { return HIGH; }
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode) {}
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode) {}
+void detachInterrupt(uint8_t pin) {}
+
+// Seeded the same on every run so shuffled playlists repeat and frame dumps can be compared
+long random(long max) {
+    return max > 0 ? rng() % max : 0;
+}
+
+long random(long min, long max) {
+    return min >= max ? min : min + random(max - min);
+}
+
+void randomSeed(unsigned long seed) {
+    rng.seed(seed);
+}
+
+uint32_t esp_random() {
+    return rng();
+}
+
+size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t length = strlen(src);
+    if (size > 0) {
+        size_t n = min(length, size - 1);
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return length;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    return malloc(size);
+}
+
+void heap_caps_free(void* ptr) {
+    free(ptr);
+}
+
+String::String(double value, unsigned decimals) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    s_ = buf;
+}
+
+size_t Print::printf(const char* format, ...) {
+    char stack_buf[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(stack_buf, sizeof(stack_buf), format, args);
+    va_end(args);
+    if (length < 0) {
+        return 0;
+    }
+    if ((size_t)length < sizeof(stack_buf)) {
+        return write(reinterpret_cast<const uint8_t*>(stack_buf), length);
+    }
+    std::vector<char> heap_buf(length + 1);
+    va_start(args, format);
+    vsnprintf(heap_buf.data(), heap_buf.size(), format, args);
+    va_end(args);
+    return write(reinterpret_cast<const uint8_t*>(heap_buf.data()), length);
+}
+
+size_t Stream::readBytes(char* buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+        int c = read();
+        if (c < 0) {
+            break;
+        }
+        buffer[count++] = c;
+    }
+    return count;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    return fwrite(buffer, 1, size, stdout);
+}
+
+void EspClass::restart() {
+    fprintf(stderr, "ESP.restart() called, exiting\n");
+    fflush(stdout);
+    _exit(0);
+}
+
+uint32_t EspClass::getCycleCount() {
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+    return ns * getCpuFreqMHz() / 1000;
+}
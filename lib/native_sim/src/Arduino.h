@@ -0,0 +1,147 @@
+#pragma once
+
+// Host stand-in for the subset of the ESP32 Arduino core the display pipeline uses
+
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "esp_heap_caps.h"
+#include "freertos_sim.h"
+
+using std::min;
+using std::max;
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define PROGMEM
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x02
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define digitalPinToInterrupt(p) (p)
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#ifndef CORE_DEBUG_LEVEL
+#define CORE_DEBUG_LEVEL 4
+#endif
+
+#define SIM_LOG(letter, format, ...) fprintf(stderr, "[%6u][" letter "] %s(): " format "\n", millis(), __FUNCTION__, ##__VA_ARGS__)
+#define log_n(format, ...) SIM_LOG("N", format, ##__VA_ARGS__)
+#define log_e(format, ...) SIM_LOG("E", format, ##__VA_ARGS__)
+#define log_w(format, ...) SIM_LOG("W", format, ##__VA_ARGS__)
+#define log_i(format, ...) SIM_LOG("I", format, ##__VA_ARGS__)
+#if CORE_DEBUG_LEVEL >= 4
+#define log_d(format, ...) SIM_LOG("D", format, ##__VA_ARGS__)
+#else
+#define log_d(format, ...) do {} while (0)
+#endif
+#define log_v(format, ...) do {} while (0)
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+uint32_t esp_random();
+
+size_t strlcpy(char* dst, const char* src, size_t size);
+
+class String {
+    public:
+        String() {}
+        String(const char* s) : s_(s != nullptr ? s : "") {}
+        String(const std::string& s) : s_(s) {}
+        String(char c) : s_(1, c) {}
+        String(int value) : s_(std::to_string(value)) {}
+        String(unsigned value) : s_(std::to_string(value)) {}
+        String(long value) : s_(std::to_string(value)) {}
+        String(unsigned long value) : s_(std::to_string(value)) {}
+        String(float value, unsigned decimals = 2) : String((double)value, decimals) {}
+        String(double value, unsigned decimals = 2);
+
+        const char* c_str() const { return s_.c_str(); }
+        unsigned length() const { return s_.length(); }
+
+        String& operator+=(const String& other) { s_ += other.s_; return *this; }
+        String operator+(const String& other) const { return String(s_ + other.s_); }
+        String operator+(const char* other) const { return String(s_ + other); }
+        bool operator==(const String& other) const { return s_ == other.s_; }
+        bool operator!=(const String& other) const { return s_ != other.s_; }
+
+    private:
+        std::string s_;
+};
+
+inline String operator+(const char* a, const String& b) {
+    return String(a) + b;
+}
+
+class Print {
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) { return write(&c, 1); }
+        virtual size_t write(const uint8_t* buffer, size_t size) { return 0; }
+
+        size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+        size_t print(const char* s) { return write(reinterpret_cast<const uint8_t*>(s), strlen(s)); }
+        size_t print(const String& s) { return print(s.c_str()); }
+        size_t println(const char* s = "") { return print(s) + print("\n"); }
+        size_t println(const String& s) { return println(s.c_str()); }
+};
+
+class Stream : public Print {
+    public:
+        virtual int available() { return 0; }
+        virtual int read() { return -1; }
+        virtual size_t readBytes(char* buffer, size_t length);
+        size_t readBytes(uint8_t* buffer, size_t length) { return readBytes(reinterpret_cast<char*>(buffer), length); }
+};
+
+// Writes to stdout
+class HardwareSerial : public Stream {
+    public:
+        void begin(unsigned long baud) {}
+        size_t write(const uint8_t* buffer, size_t size) override;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+    public:
+        void restart();
+        uint32_t getFreeHeap() { return 0; }
+        uint32_t getCpuFreqMHz() { return 240; }
+        // Derived from the host's monotonic clock at the device's nominal frequency
+        uint32_t getCycleCount();
+};
+
+extern EspClass ESP;
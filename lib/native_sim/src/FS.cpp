@@ -0,0 +1,177 @@
+#include "FS.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SD_MMC.h"
+
+namespace fs {
+
+struct FileImpl {
+    std::string path;
+    std::string host_path;
+    FILE* file = nullptr;
+    DIR* dir = nullptr;
+
+    ~FileImpl() {
+        close();
+    }
+
+    void close() {
+        if (file != nullptr) {
+            fclose(file);
+            file = nullptr;
+        }
+        if (dir != nullptr) {
+            closedir(dir);
+            dir = nullptr;
+        }
+    }
+};
+
+File::operator bool() const {
+    return impl_ && (impl_->file != nullptr || impl_->dir != nullptr);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+    return *this && impl_->file != nullptr ? fwrite(buffer, 1, size, impl_->file) : 0;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+    return *this && impl_->file != nullptr ? fread(buffer, 1, size, impl_->file) : 0;
+}
+
+int File::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::available() {
+    return *this && impl_->file != nullptr ? size() - position() : 0;
+}
+
+size_t File::readBytes(char* buffer, size_t length) {
+    return read(reinterpret_cast<uint8_t*>(buffer), length);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+    static const int whence[] = {SEEK_SET, SEEK_CUR, SEEK_END};
+    return *this && impl_->file != nullptr && fseek(impl_->file, pos, whence[mode]) == 0;
+}
+
+size_t File::position() const {
+    return *this && impl_->file != nullptr ? ftell(impl_->file) : 0;
+}
+
+size_t File::size() const {
+    struct stat st;
+    if (!*this || impl_->file == nullptr || fstat(fileno(impl_->file), &st) != 0) {
+        return 0;
+    }
+    return st.st_size;
+}
+
+void File::flush() {
+    if (*this && impl_->file != nullptr) {
+        fflush(impl_->file);
+    }
+}
+
+void File::close() {
+    if (impl_) {
+        impl_->close();
+    }
+}
+
+const char* File::name() const {
+    return impl_ ? impl_->path.c_str() : "";
+}
+
+bool File::isDirectory() const {
+    return *this && impl_->dir != nullptr;
+}
+
+File File::openNextFile(const char* mode) {
+    if (!isDirectory()) {
+        return File();
+    }
+    while (dirent* entry = readdir(impl_->dir)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        std::string path = impl_->path;
+        if (path.empty() || path.back() != '/') {
+            path += '/';
+        }
+        path += entry->d_name;
+        return SD_MMC.open(path.c_str(), mode);
+    }
+    return File();
+}
+
+void File::rewindDirectory() {
+    if (isDirectory()) {
+        rewinddir(impl_->dir);
+    }
+}
+
+std::string FS::hostPath(const char* path) const {
+    return root_ + (path[0] == '/' ? "" : "/") + path;
+}
+
+File FS::open(const char* path, const char* mode) {
+    if (root_.empty()) {
+        return File();
+    }
+    auto impl = std::make_shared<FileImpl>();
+    impl->path = path;
+    impl->host_path = hostPath(path);
+
+    struct stat st;
+    if (strcmp(mode, FILE_READ) == 0 && stat(impl->host_path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        impl->dir = opendir(impl->host_path.c_str());
+    } else {
+        // Binary mode; "r" on the device never translates line endings either
+        std::string host_mode = std::string(mode) + "b";
+        impl->file = fopen(impl->host_path.c_str(), host_mode.c_str());
+    }
+    return File(impl);
+}
+
+bool FS::exists(const char* path) {
+    struct stat st;
+    return !root_.empty() && stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path) {
+    return !root_.empty() && unlink(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* path_from, const char* path_to) {
+    return !root_.empty() && ::rename(hostPath(path_from).c_str(), hostPath(path_to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+    return !root_.empty() && ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+bool FS::rmdir(const char* path) {
+    return !root_.empty() && ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+bool SDMMCFS::begin(const char* mountpoint, bool mode1bit, bool format_if_mount_failed) {
+    struct stat st;
+    if (stat(mountpoint, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return false;
+    }
+    root_ = mountpoint;
+    return true;
+}
+
+void SDMMCFS::end() {
+    root_.clear();
+}
+
+}
+
+fs::SDMMCFS SD_MMC;
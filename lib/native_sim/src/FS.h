@@ -0,0 +1,73 @@
+#pragma once
+
+#include <dirent.h>
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2,
+};
+
+struct FileImpl;
+
+// A file or directory in the host directory the card is mounted from. Copies share the open handle, as on the device.
+class File : public Stream {
+    public:
+        File() {}
+        explicit File(std::shared_ptr<FileImpl> impl) : impl_(impl) {}
+
+        explicit operator bool() const;
+        size_t write(const uint8_t* buffer, size_t size) override;
+        size_t read(uint8_t* buffer, size_t size);
+        int read() override;
+        int available() override;
+        size_t readBytes(char* buffer, size_t length) override;
+        bool seek(uint32_t pos, SeekMode mode = SeekSet);
+        size_t position() const;
+        size_t size() const;
+        void flush();
+        void close();
+        // The path on the card, like Arduino-ESP32 1.x
+        const char* name() const;
+        bool isDirectory() const;
+        File openNextFile(const char* mode = FILE_READ);
+        void rewindDirectory();
+
+    private:
+        std::shared_ptr<FileImpl> impl_;
+};
+
+class FS {
+    public:
+        File open(const char* path, const char* mode = FILE_READ);
+        File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+        bool exists(const char* path);
+        bool exists(const String& path) { return exists(path.c_str()); }
+        bool remove(const char* path);
+        bool rename(const char* path_from, const char* path_to);
+        bool mkdir(const char* path);
+        bool rmdir(const char* path);
+
+    protected:
+        // Host directory that card paths are relative to; empty until mounted
+        std::string root_;
+
+        std::string hostPath(const char* path) const;
+};
+
+}
+
+using fs::File;
+using fs::FS;
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "FS.h"
+
+namespace fs {
+
+class SDMMCFS : public FS {
+    public:
+        // Mounts the host directory named by mountpoint, which the firmware also uses as the VFS prefix for POSIX
+        // calls. The simulator builds with a mount point of "." and runs from the card directory.
+        bool begin(const char* mountpoint = "/sdcard", bool mode1bit = false, bool format_if_mount_failed = false);
+        void end();
+};
+
+}
+
+extern fs::SDMMCFS SD_MMC;
@@ -0,0 +1,154 @@
+#include "TFT_eSPI.h"
+
+static TFT_eSPI* active_panel = nullptr;
+
+TFT_eSPI::TFT_eSPI(int16_t w, int16_t h) : panel_width_(w), panel_height_(h), width_(w), height_(h),
+        pixels_(w * h, TFT_BLACK) {}
+
+void TFT_eSPI::begin() {
+    active_panel = this;
+}
+
+TFT_eSPI* TFT_eSPI::active() {
+    return active_panel;
+}
+
+void TFT_eSPI::setRotation(uint8_t rotation) {
+    bool landscape = rotation & 1;
+    width_ = landscape ? panel_height_ : panel_width_;
+    height_ = landscape ? panel_width_ : panel_height_;
+    // Only the orientation matters here; the framebuffer is kept in the rotated orientation
+    std::fill(pixels_.begin(), pixels_.end(), TFT_BLACK);
+    dirty_ = true;
+}
+
+void TFT_eSPI::setAddrWindow(int32_t x, int32_t y, int32_t w, int32_t h) {
+    window_x0_ = x;
+    window_y0_ = y;
+    window_x1_ = x + w - 1;
+    window_y1_ = y + h - 1;
+    cursor_x_ = x;
+    cursor_y_ = y;
+}
+
+// Pixels outside the screen are consumed without being drawn, as the controller does
+void TFT_eSPI::writePixel(uint16_t color) {
+    if (cursor_x_ >= 0 && cursor_x_ < width_ && cursor_y_ >= 0 && cursor_y_ < height_) {
+        pixels_[cursor_y_ * width_ + cursor_x_] = color;
+    }
+    if (++cursor_x_ > window_x1_) {
+        cursor_x_ = window_x0_;
+        if (++cursor_y_ > window_y1_) {
+            cursor_y_ = window_y0_;
+        }
+    }
+}
+
+void TFT_eSPI::pushPixels(const void* data, uint32_t len) {
+    const uint16_t* words = static_cast<const uint16_t*>(data);
+    for (uint32_t i = 0; i < len; i++) {
+        uint16_t word = words[i];
+        writePixel(swap_bytes_ ? word : (uint16_t)((word << 8) | (word >> 8)));
+    }
+    dirty_ = true;
+}
+
+void TFT_eSPI::pushBlock(uint16_t color, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        writePixel(color);
+    }
+    dirty_ = true;
+}
+
+void TFT_eSPI::fillScreen(uint32_t color) {
+    fillRect(0, 0, width_, height_, color);
+}
+
+void TFT_eSPI::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+    int32_t x0 = max(x, (int32_t)0);
+    int32_t y0 = max(y, (int32_t)0);
+    int32_t x1 = min(x + w, (int32_t)width_);
+    int32_t y1 = min(y + h, (int32_t)height_);
+    for (int32_t row = y0; row < y1; row++) {
+        std::fill(pixels_.data() + row * width_ + x0, pixels_.data() + row * width_ + max(x0, x1), (uint16_t)color);
+    }
+    dirty_ = true;
+}
+
+int16_t TFT_eSPI::drawString(const char* string, int32_t x, int32_t y) {
+    fprintf(stderr, "[%6u][TFT] drawString(%d, %d): %s\n", millis(), x, y, string);
+    return textWidth(string);
+}
+
+bool TFT_eSPI::takeDirty() {
+    bool dirty = dirty_;
+    dirty_ = false;
+    return dirty;
+}
+
+// FNV-1a over the visible pixels, for checking frame output without keeping the frames
+uint32_t TFT_eSPI::hash() const {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < width_ * height_; i++) {
+        h = (h ^ (pixels_[i] & 0xFF)) * 16777619u;
+        h = (h ^ (pixels_[i] >> 8)) * 16777619u;
+    }
+    return h;
+}
+
+bool TFT_eSPI::writePpm(const char* path) const {
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width_, height_);
+    std::vector<uint8_t> row(width_ * 3);
+    for (int y = 0; y < height_; y++) {
+        for (int x = 0; x < width_; x++) {
+            uint16_t color = pixels_[y * width_ + x];
+            uint8_t r = (color >> 11) & 0x1F;
+            uint8_t g = (color >> 5) & 0x3F;
+            uint8_t b = color & 0x1F;
+            row[x * 3] = (r << 3) | (r >> 2);
+            row[x * 3 + 1] = (g << 2) | (g >> 4);
+            row[x * 3 + 2] = (b << 3) | (b >> 2);
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+    return fclose(file) == 0;
+}
+
+void* TFT_eSprite::createSprite(int16_t w, int16_t h, uint8_t frames) {
+    sprite_width_ = w;
+    sprite_height_ = h;
+    image_.assign(w * h, TFT_BLACK);
+    return image_.data();
+}
+
+void TFT_eSprite::deleteSprite() {
+    image_.clear();
+    sprite_width_ = 0;
+    sprite_height_ = 0;
+}
+
+void TFT_eSprite::fill(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color) {
+    uint16_t swapped = (color << 8) | (color >> 8);
+    for (int32_t row = max(y, (int32_t)0); row < min(y + h, (int32_t)sprite_height_); row++) {
+        for (int32_t col = max(x, (int32_t)0); col < min(x + w, (int32_t)sprite_width_); col++) {
+            image_[row * sprite_width_ + col] = swapped;
+        }
+    }
+}
+
+void TFT_eSprite::fillSprite(uint32_t color) {
+    fill(0, 0, sprite_width_, sprite_height_, color);
+}
+
+int16_t TFT_eSprite::drawString(const char* string, int32_t x, int32_t y) {
+    for (const char* c = string; *c != '\0'; c++, x += 6) {
+        if (*c != ' ') {
+            fill(x, y, 5, 7, text_color_);
+        }
+    }
+    return textWidth(string);
+}
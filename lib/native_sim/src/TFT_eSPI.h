@@ -0,0 +1,121 @@
+#pragma once
+
+// Host stand-in for TFT_eSPI that draws into an in-memory RGB565 framebuffer the simulator can dump. Pixels are
+// stored as the panel would show them: pushed buffers are byte swapped unless setSwapBytes(true), exactly like the
+// bytes that go over SPI on the device, while colors passed by value are native.
+
+#include <vector>
+
+#include "Arduino.h"
+
+#ifndef TFT_WIDTH
+#define TFT_WIDTH 135
+#endif
+#ifndef TFT_HEIGHT
+#define TFT_HEIGHT 240
+#endif
+
+#define TFT_BLACK 0x0000
+#define TFT_NAVY 0x000F
+#define TFT_DARKGREEN 0x03E0
+#define TFT_DARKGREY 0x7BEF
+#define TFT_BLUE 0x001F
+#define TFT_GREEN 0x07E0
+#define TFT_RED 0xF800
+#define TFT_YELLOW 0xFFE0
+#define TFT_WHITE 0xFFFF
+
+#define TL_DATUM 0
+#define TC_DATUM 1
+#define TR_DATUM 2
+#define ML_DATUM 3
+#define MC_DATUM 4
+#define MR_DATUM 5
+#define BL_DATUM 6
+#define BC_DATUM 7
+#define BR_DATUM 8
+
+class TFT_eSPI : public Print {
+    public:
+        TFT_eSPI(int16_t w = TFT_WIDTH, int16_t h = TFT_HEIGHT);
+
+        void begin();
+        void setRotation(uint8_t rotation);
+        int16_t width() const { return width_; }
+        int16_t height() const { return height_; }
+
+        void startWrite() {}
+        void endWrite() {}
+        void setAddrWindow(int32_t x, int32_t y, int32_t w, int32_t h);
+        void pushPixels(const void* data, uint32_t len);
+        void pushBlock(uint16_t color, uint32_t len);
+        void setSwapBytes(bool swap) { swap_bytes_ = swap; }
+        bool getSwapBytes() const { return swap_bytes_; }
+
+        // Transfers complete immediately
+        bool initDMA(bool ctrl_cs = false) { return true; }
+        void deInitDMA() {}
+        void pushPixelsDMA(uint16_t* image, uint32_t len) { pushPixels(image, len); }
+        void dmaWait() {}
+        bool dmaBusy() { return false; }
+
+        void fillScreen(uint32_t color);
+        void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+
+        // Text is not rasterized; strings are echoed to stderr so screens like the credits can still be followed
+        void setTextColor(uint16_t color) {}
+        void setTextColor(uint16_t fg, uint16_t bg) {}
+        void setTextDatum(uint8_t datum) {}
+        void setTextSize(uint8_t size) {}
+        int16_t drawString(const char* string, int32_t x, int32_t y);
+        int16_t drawString(const String& string, int32_t x, int32_t y) { return drawString(string.c_str(), x, y); }
+        int16_t textWidth(const char* string) { return strlen(string) * 6; }
+
+        // Simulator only: the panel most recently begun, the panel contents, and whether they changed since the
+        // last call to takeDirty()
+        static TFT_eSPI* active();
+        const std::vector<uint16_t>& pixels() const { return pixels_; }
+        bool takeDirty();
+        uint32_t hash() const;
+        bool writePpm(const char* path) const;
+
+    private:
+        void writePixel(uint16_t color);
+
+        const int16_t panel_width_;
+        const int16_t panel_height_;
+        int16_t width_;
+        int16_t height_;
+        std::vector<uint16_t> pixels_;
+        bool dirty_ = false;
+        bool swap_bytes_ = false;
+
+        int32_t window_x0_ = 0, window_y0_ = 0, window_x1_ = 0, window_y1_ = 0;
+        int32_t cursor_x_ = 0, cursor_y_ = 0;
+};
+
+// 16 bit sprite, with pixels stored byte swapped (in panel byte order) like TFT_eSprite does. Strings are drawn as a
+// solid cell per character in the text color, which is enough to see where text lands in a dumped frame.
+class TFT_eSprite : public TFT_eSPI {
+    public:
+        explicit TFT_eSprite(TFT_eSPI* tft) : TFT_eSPI(0, 0) {}
+
+        void* createSprite(int16_t w, int16_t h, uint8_t frames = 1);
+        void deleteSprite();
+        bool created() const { return !image_.empty(); }
+        void* getPointer() { return image_.empty() ? nullptr : image_.data(); }
+
+        void fillSprite(uint32_t color);
+        void setTextColor(uint16_t color) { text_color_ = color; }
+        void setTextColor(uint16_t fg, uint16_t bg) { text_color_ = fg; }
+        int16_t drawString(const char* string, int32_t x, int32_t y);
+        int16_t drawString(const String& string, int32_t x, int32_t y) { return drawString(string.c_str(), x, y); }
+
+    private:
+        void fill(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color);
+
+        std::vector<uint16_t> image_;
+        int16_t sprite_width_ = 0;
+        int16_t sprite_height_ = 0;
+        uint16_t text_color_ = TFT_WHITE;
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Arduino.h"
+
+// Firmware updates from the card are refused, so a firmware.bin left in the simulated card is only reported
+class UpdateClass {
+    public:
+        bool begin(size_t size) { return false; }
+        size_t writeStream(Stream& data) { return 0; }
+        bool end() { return false; }
+        bool isFinished() { return false; }
+        uint8_t getError() { return 0; }
+};
+
+extern UpdateClass Update;
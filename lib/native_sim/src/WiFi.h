@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Arduino.h"
+
+// The simulator never connects
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+#define WIFI_STA 1
+
+class IPAddress {
+    public:
+        String toString() const { return "0.0.0.0"; }
+};
+
+class WiFiClass {
+    public:
+        void mode(int mode) {}
+        void begin(const char* ssid, const char* password) {}
+        wl_status_t status() { return WL_DISCONNECTED; }
+        IPAddress localIP() { return IPAddress(); }
+};
+
+extern WiFiClass WiFi;
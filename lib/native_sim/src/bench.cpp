@@ -0,0 +1,250 @@
+#include "bench.h"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include <json11.hpp>
+
+#include "Arduino.h"
+#include "SD_MMC.h"
+#include "TFT_eSPI.h"
+#include "gif_player.h"
+
+using namespace json11;
+
+struct RenderMode {
+    const char* name;
+    bool frame_buffer;
+    bool composite;
+};
+
+static const RenderMode kRenderModes[] = {
+    {"direct", false, false},
+    {"composite", false, true},
+    {"frame_buffer", true, false},
+};
+
+struct CaseResult {
+    std::string name;
+    uint32_t frames;        // per loop
+    double fps;
+    uint32_t bytes_read;    // per loop, from the card
+    uint32_t draw_calls;    // per loop, GIFDraw callbacks
+    uint32_t windows;       // per loop, address windows set on the panel
+    uint32_t pushed_bytes;  // per loop
+};
+
+static std::vector<std::string> listGifs(const std::string& dir) {
+    std::vector<std::string> names;
+    DIR* listing = opendir(dir.c_str());
+    if (listing == nullptr) {
+        return names;
+    }
+    while (dirent* entry = readdir(listing)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && strcasecmp(name.c_str() + name.size() - 4, ".gif") == 0) {
+            names.push_back(name);
+        }
+    }
+    closedir(listing);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+// Plays the gif from start to end loops times. Counts are per loop; fps is from the fastest loop, which is the least
+// disturbed by whatever else the host is doing.
+static bool runCase(const std::string& gif_name, const RenderMode& mode, int loops, CaseResult* result) {
+    std::string path = "/" + gif_name;
+    uint64_t frames = 0, bytes_read = 0, draw_calls = 0, windows = 0, pushed_bytes = 0;
+    uint32_t fastest_us = UINT32_MAX;
+    for (int i = 0; i < loops; i++) {
+        if (!GifPlayer::start(path.c_str())) {
+            return false;
+        }
+        int frame_delay;
+        while (GifPlayer::play_frame(&frame_delay)) {
+        }
+        GifPlayer::FrameStats stats = GifPlayer::get_stats();
+        BlockReader::Stats io = GifPlayer::get_io_stats();
+        GifPlayer::stop();
+
+        frames += stats.frames;
+        fastest_us = min(fastest_us, stats.render_us);
+        bytes_read += io.sd_bytes;
+        draw_calls += stats.lines;
+        windows += stats.window_commands;
+        pushed_bytes += stats.pushed_bytes;
+    }
+
+    result->name = gif_name.substr(0, gif_name.size() - 4) + "/" + mode.name;
+    result->frames = frames / loops;
+    result->fps = fastest_us > 0 ? result->frames * 1000000.0 / fastest_us : 0;
+    result->bytes_read = bytes_read / loops;
+    result->draw_calls = draw_calls / loops;
+    result->windows = windows / loops;
+    result->pushed_bytes = pushed_bytes / loops;
+    return true;
+}
+
+static Json toJson(const std::vector<CaseResult>& results, int loops, bool with_fps) {
+    Json::array cases;
+    for (const CaseResult& result : results) {
+        Json::object entry {
+            {"name", result.name},
+            {"frames", (int)result.frames},
+            {"bytes_read", (int)result.bytes_read},
+            {"draw_calls", (int)result.draw_calls},
+            {"windows", (int)result.windows},
+            {"pushed_bytes", (int)result.pushed_bytes},
+        };
+        if (with_fps) {
+            entry["fps"] = result.fps;
+        }
+        cases.push_back(entry);
+    }
+    return Json::object {
+        {"loops", loops},
+        {"cases", cases},
+    };
+}
+
+static bool readFile(const std::string& path, std::string* contents) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        contents->append(buf, n);
+    }
+    fclose(file);
+    return true;
+}
+
+static bool writeFile(const std::string& path, const std::string& contents) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    return fclose(file) == 0 && ok;
+}
+
+int runBench(const BenchOptions& options) {
+    std::vector<std::string> gifs = listGifs(options.corpus_dir);
+    if (gifs.empty() || !SD_MMC.begin(options.corpus_dir.c_str())) {
+        fprintf(stderr, "No gifs found in %s\n", options.corpus_dir.c_str());
+        return 1;
+    }
+
+    std::map<std::string, Json> baseline;
+    if (!options.baseline_path.empty() && !options.update_baseline) {
+        std::string contents, err;
+        if (!readFile(options.baseline_path, &contents)) {
+            fprintf(stderr, "No baseline at %s; run with --update-baseline to record one\n", options.baseline_path.c_str());
+            return 1;
+        }
+        Json json = Json::parse(contents, err);
+        if (!err.empty()) {
+            fprintf(stderr, "Could not parse %s: %s\n", options.baseline_path.c_str(), err.c_str());
+            return 1;
+        }
+        for (const Json& entry : json["cases"].array_items()) {
+            baseline[entry["name"].string_value()] = entry;
+        }
+        if (baseline.empty()) {
+            fprintf(stderr, "No cases in %s\n", options.baseline_path.c_str());
+            return 1;
+        }
+    }
+
+    TFT_eSPI tft;
+    tft.begin();
+    tft.setRotation(1);
+    GifPlayer::begin(&tft);
+
+    std::vector<CaseResult> results;
+    int regressions = 0;
+    printf("%-32s %7s %10s %8s %8s\n", "case", "frames", "fps", "bytes", "draws");
+    for (const RenderMode& mode : kRenderModes) {
+        bool ok = mode.composite ? GifPlayer::set_composite(true) : GifPlayer::set_frame_buffer(mode.frame_buffer);
+        if (!ok) {
+            fprintf(stderr, "Could not set up %s rendering\n", mode.name);
+            return 1;
+        }
+        for (const std::string& gif : gifs) {
+            CaseResult result;
+            if (!runCase(gif, mode, options.loops, &result)) {
+                fprintf(stderr, "Could not play %s\n", gif.c_str());
+                return 1;
+            }
+            results.push_back(result);
+            printf("%-32s %7u %10.1f %8u %8u", result.name.c_str(), result.frames, result.fps, result.bytes_read, result.draw_calls);
+
+            if (baseline.empty()) {
+                printf("\n");
+                continue;
+            }
+            auto it = baseline.find(result.name);
+            if (it == baseline.end()) {
+                // A new gif or mode needs a new baseline, otherwise it would never be compared
+                printf("  REGRESSED: not in baseline\n");
+                regressions++;
+                continue;
+            }
+            const Json& base = it->second;
+            // fps is only in baselines recorded with --record-fps on the host being compared
+            bool compare_fps = base["fps"].number_value() > 0;
+            double fps_change = compare_fps ? (result.fps / base["fps"].number_value() - 1) * 100 : 0;
+            std::string problems;
+            if (compare_fps && fps_change < -options.fps_tolerance_percent) {
+                problems += " fps";
+            }
+            if (result.bytes_read > (uint32_t)base["bytes_read"].int_value()) {
+                problems += " bytes";
+            }
+            if (result.draw_calls > (uint32_t)base["draw_calls"].int_value()) {
+                problems += " draws";
+            }
+            std::string fps_column = "     n/a";
+            if (compare_fps) {
+                char formatted[16];
+                snprintf(formatted, sizeof(formatted), "%+6.1f%%", fps_change);
+                fps_column = formatted;
+            }
+            printf("  %s fps, %+d bytes, %+d draws%s%s\n",
+                fps_column.c_str(),
+                (int)result.bytes_read - base["bytes_read"].int_value(),
+                (int)result.draw_calls - base["draw_calls"].int_value(),
+                problems.empty() ? "" : "  REGRESSED:",
+                problems.c_str());
+            if (!problems.empty()) {
+                regressions++;
+            }
+        }
+    }
+    GifPlayer::set_frame_buffer(false);
+
+    std::string json = toJson(results, options.loops, true).dump();
+    if (!options.results_path.empty() && !writeFile(options.results_path, json + "\n")) {
+        fprintf(stderr, "Could not write %s\n", options.results_path.c_str());
+        return 1;
+    }
+    if (options.update_baseline) {
+        if (!writeFile(options.baseline_path, toJson(results, options.loops, options.record_fps).dump() + "\n")) {
+            fprintf(stderr, "Could not write %s\n", options.baseline_path.c_str());
+            return 1;
+        }
+        printf("Baseline written to %s\n", options.baseline_path.c_str());
+        return 0;
+    }
+    if (regressions > 0) {
+        printf("%d of %u cases regressed (fps tolerance %.0f%%)\n", regressions, (unsigned)results.size(), options.fps_tolerance_percent);
+        return 1;
+    }
+    return 0;
+}
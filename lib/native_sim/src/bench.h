@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+// Plays every gif in a corpus directory through GifPlayer in each rendering mode, reports frames per second, bytes
+// read from the card and draw calls per case, and compares them against a stored baseline.
+struct BenchOptions {
+    std::string corpus_dir;
+    // Machine-readable results are written here when set
+    std::string results_path;
+    std::string baseline_path;
+    // Overwrite the baseline with this run's results instead of comparing against it
+    bool update_baseline = false;
+    // Store fps in the baseline as well as the counts. fps only compares against runs on the same host, so the
+    // checked-in baseline leaves it out and its cases are compared on counts alone.
+    bool record_fps = false;
+    int loops = 5;
+    // Allowed drop in frames per second before it counts as a regression, in percent. Bytes read and draw calls are
+    // deterministic, so any increase in those is a regression.
+    double fps_tolerance_percent = 10;
+};
+
+// Returns the process exit status: 0 if nothing regressed, 1 if a case regressed, is missing from the baseline or the
+// baseline could not be read
+int runBench(const BenchOptions& options);
+
+// Times the line drawing kernels on the host against the loops they replaced, after checking that they agree.
+// Returns the process exit status: 1 if a kernel produced different pixels.
+int runKernelBench();
@@ -0,0 +1,244 @@
+#include "freertos_sim.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Arduino.h"
+#include "sim.h"
+
+struct SimTask {
+    std::string name;
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notify_value = 0;
+    bool notified = false;
+};
+
+// Semaphores are queues of zero-sized items, as in FreeRTOS
+struct SimQueue {
+    size_t item_size;
+    size_t capacity;
+    std::deque<std::vector<uint8_t>> items;
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+static thread_local SimTask* current_task = nullptr;
+
+// Waits on cv until ready() or ticks ms of real time pass; portMAX_DELAY waits forever
+template<typename Predicate>
+static bool waitFor(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, TickType_t ticks, Predicate ready) {
+    if (ticks == portMAX_DELAY) {
+        cv.wait(lock, ready);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*function)(void*), const char* name, uint32_t stack_depth, void* params,
+        UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    SimTask* task = new SimTask();
+    task->name = name;
+    // The handle must be valid before the task runs, as Task<T> hands it out from the new thread
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    std::thread([task, function, params]() {
+        current_task = task;
+        function(params);
+    }).detach();
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr || task == current_task) {
+        pthread_exit(nullptr);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks);
+}
+
+TickType_t xTaskGetTickCount() {
+    return millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    if (current_task == nullptr) {
+        // A thread that wasn't created as a task, e.g. main()
+        current_task = new SimTask();
+        current_task->name = "main";
+    }
+    return current_task;
+}
+
+const char* pcTaskGetTaskName(TaskHandle_t task) {
+    return (task != nullptr ? task : xTaskGetCurrentTaskHandle())->name.c_str();
+}
+
+BaseType_t xPortGetCoreID() {
+    return 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    SimTask* task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    waitFor(task->cv, lock, ticks, [task]() { return task->notify_value > 0; });
+    uint32_t value = task->notify_value;
+    if (value > 0) {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    switch (action) {
+        case eNoAction:
+            break;
+        case eSetBits:
+            task->notify_value |= value;
+            break;
+        case eIncrement:
+            task->notify_value++;
+            break;
+        case eSetValueWithoutOverwrite:
+            if (task->notified) {
+                return pdFAIL;
+            }
+            task->notify_value = value;
+            break;
+        case eSetValueWithOverwrite:
+            task->notify_value = value;
+            break;
+    }
+    task->notified = true;
+    task->cv.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value, TickType_t ticks) {
+    SimTask* task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    if (!task->notified) {
+        task->notify_value &= ~clear_on_entry;
+    }
+    bool received = waitFor(task->cv, lock, ticks, [task]() { return task->notified; });
+    if (value != nullptr) {
+        *value = task->notify_value;
+    }
+    if (!received) {
+        return pdFALSE;
+    }
+    task->notified = false;
+    task->notify_value &= ~clear_on_exit;
+    return pdTRUE;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t* woken) {
+    return xTaskNotify(task, value, action);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken) {
+    xTaskNotifyGive(task);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    SimQueue* queue = new SimQueue();
+    queue->item_size = item_size;
+    queue->capacity = length;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    return xQueueSendToBack(queue, item, ticks);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitFor(queue->cv, lock, ticks, [queue]() { return queue->items.size() < queue->capacity; })) {
+        return pdFALSE;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(item);
+    queue->items.emplace_back(bytes, bytes + queue->item_size);
+    queue->cv.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken) {
+    return xQueueSendToBack(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    auto ready = [queue]() { return !queue->items.empty(); };
+    if (!sim::isRealtime() && ticks != 0 && ticks != portMAX_DELAY && !ready()) {
+        // A timed wait for input stands in for a delay() until the next frame, so it is skipped in virtual time
+        // like one, after giving anything already on its way a moment to arrive
+        if (!queue->cv.wait_for(lock, std::chrono::milliseconds(1), ready)) {
+            lock.unlock();
+            delay(ticks);
+            lock.lock();
+        }
+        if (!ready()) {
+            return pdFALSE;
+        }
+    } else if (!waitFor(queue->cv, lock, ticks, ready)) {
+        return pdFALSE;
+    }
+    if (queue->item_size > 0) {
+        memcpy(item, queue->items.front().data(), queue->item_size);
+    }
+    queue->items.pop_front();
+    queue->cv.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    const uint8_t* bytes = static_cast<const uint8_t*>(item);
+    queue->items.clear();
+    queue->items.emplace_back(bytes, bytes + queue->item_size);
+    queue->cv.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    SimQueue* semaphore = xQueueCreate(1, 0);
+    semaphore->items.emplace_back();
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return xQueueCreate(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    return xQueueReceive(semaphore, nullptr, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return xQueueSendToBack(semaphore, nullptr, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    delete semaphore;
+}
@@ -0,0 +1,463 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TFT_eSPI.h"
+#include "cycle_timer.h"
+#include "gif_player.h"
+#include "palette_expand.h"
+#include "presenter_task.h"
+
+#define KERNEL_BENCH_REPEATS 7  // the fastest repeat is reported, as the least disturbed by the rest of the host
+#define KERNEL_BENCH_ITERATIONS 20000
+#define KERNEL_BENCH_MAX_WIDTH 320
+#define KERNEL_BENCH_MAX_SCALE MAX_UPSCALE
+#define KERNEL_BENCH_TRANSPARENT 0xFF  // palette index of transparent pixels in the draw kernel lines
+
+static const int kLineWidths[] = {32, 135, 240, 256};
+
+// Keeps the compiler from hoisting a kernel out of the timing loop or dropping its stores
+static inline void clobber() {
+    asm volatile("" : : : "memory");
+}
+
+// Fastest of KERNEL_BENCH_REPEATS runs of iterations calls to fn, in CPU cycles per call, read from the same counter
+// as CycleTimer
+template<typename F>
+static double cyclesPerCall(int iterations, F fn) {
+    uint32_t best = 0;
+    for (int repeat = 0; repeat < KERNEL_BENCH_REPEATS; repeat++) {
+        uint32_t start = ESP.getCycleCount();
+        for (int i = 0; i < iterations; i++) {
+            fn();
+            clobber();
+        }
+        uint32_t cycles = ESP.getCycleCount() - start;
+        if (repeat == 0 || cycles < best) {
+            best = cycles;
+        }
+    }
+    return (double)best / iterations;
+}
+
+// The byte-at-a-time loop palette_expand() replaced
+static void __attribute__((noinline)) scalarExpand(uint16_t* dst, const uint8_t* src, const uint16_t* palette, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = palette[src[i]];
+    }
+}
+
+template<int SCALE>
+static void __attribute__((noinline)) scalarExpandScaled(uint16_t* dst, const uint8_t* src, const uint16_t* palette, int count) {
+    for (int i = 0; i < count; i++) {
+        uint16_t color = palette[src[i]];
+        for (int j = 0; j < SCALE; j++) {
+            *dst++ = color;
+        }
+    }
+}
+
+static void __attribute__((noinline)) kernelExpand(uint16_t* dst, const uint8_t* src, const uint16_t* palette, int count) {
+    palette_expand(dst, src, palette, count);
+}
+
+template<int SCALE>
+static void __attribute__((noinline)) kernelExpandScaled(uint16_t* dst, const uint8_t* src, const uint16_t* palette, int count) {
+    palette_expand_scaled<SCALE>(dst, src, palette, count);
+}
+
+typedef void (*ExpandFunction)(uint16_t* dst, const uint8_t* src, const uint16_t* palette, int count);
+
+struct ExpandCase {
+    const char* name;
+    int scale;
+    ExpandFunction scalar;
+    ExpandFunction kernel;
+};
+
+static const ExpandCase kExpandCases[] = {
+    {"palette_expand", 1, scalarExpand, kernelExpand},
+    {"palette_expand_scaled<2>", 2, scalarExpandScaled<2>, kernelExpandScaled<2>},
+    {"palette_expand_scaled<3>", 3, scalarExpandScaled<3>, kernelExpandScaled<3>},
+};
+
+// Times each palette expansion kernel against the scalar loop it replaced, after checking they agree
+static bool benchPaletteExpand() {
+    static uint16_t palette[256];
+    static uint8_t src[KERNEL_BENCH_MAX_WIDTH];
+    static uint16_t expected[KERNEL_BENCH_MAX_WIDTH * KERNEL_BENCH_MAX_SCALE];
+    static uint16_t actual[KERNEL_BENCH_MAX_WIDTH * KERNEL_BENCH_MAX_SCALE];
+    srand(1);
+    for (uint16_t& color : palette) {
+        color = rand();
+    }
+    for (uint8_t& index : src) {
+        index = rand();
+    }
+
+    printf("Cycles per call at %u MHz\n", (unsigned)ESP.getCpuFreqMHz());
+    printf("%-28s %6s %12s %12s %8s\n", "palette kernel", "width", "scalar cyc", "kernel cyc", "speedup");
+    for (const ExpandCase& expand : kExpandCases) {
+        for (int width : kLineWidths) {
+            int pixels = width / expand.scale;
+            expand.scalar(expected, src, palette, pixels);
+            expand.kernel(actual, src, palette, pixels);
+            if (memcmp(expected, actual, pixels * expand.scale * sizeof(uint16_t)) != 0) {
+                fprintf(stderr, "%s disagrees with the scalar loop at width %d\n", expand.name, width);
+                return false;
+            }
+            double scalar = cyclesPerCall(KERNEL_BENCH_ITERATIONS, [&]() { expand.scalar(actual, src, palette, pixels); });
+            double kernel = cyclesPerCall(KERNEL_BENCH_ITERATIONS, [&]() { expand.kernel(actual, src, palette, pixels); });
+            printf("%-28s %6d %12.1f %12.1f %7.2fx\n", expand.name, width, scalar, kernel, scalar / kernel);
+        }
+    }
+    return true;
+}
+
+// Runs GifPlayer's per-target draw kernels line by line, and the generic GIFDraw they replaced for comparison. Derives
+// from GifPlayer so the old GIFDraw finds its members unqualified, as it did as a member.
+class KernelBench : public GifPlayer {
+    public:
+        static bool run();
+
+    private:
+        static const char* const kTargetNames[GifPlayer::DRAW_TARGETS];
+        static const char* const kModeNames[GifPlayer::PIXEL_MODES];
+        // The log clip the old GIFDraw checked, since replaced by blending; -1 as the bench doesn't show the log
+        static const int max_line = -1;
+
+        static void setTarget(GifPlayer::DrawTarget target, int scale);
+        static void genericDraw(GIFDRAW *pDraw);
+        static void genericDrawFrameBuffer(GIFDRAW *pDraw, int iWidth, int y);
+};
+
+const char* const KernelBench::kTargetNames[GifPlayer::DRAW_TARGETS] = {
+    "direct", "dma", "presenter", "buffer", "buffer_repaint",
+};
+const char* const KernelBench::kModeNames[GifPlayer::PIXEL_MODES] = {
+    "opaque", "transparent", "restore",
+};
+
+// Puts GifPlayer in the state start() and play_frame() would leave it in for target, then picks its kernels
+void KernelBench::setTarget(GifPlayer::DrawTarget target, int scale) {
+    static PresenterTask* presenter = nullptr;
+    if (GifPlayer::presenter != nullptr) {
+        GifPlayer::presenter->drain();
+        GifPlayer::presenter = nullptr;
+    }
+    GifPlayer::free_dma_lines();
+    GifPlayer::set_frame_buffer(false);
+
+    switch (target) {
+        case GifPlayer::DRAW_DMA:
+            GifPlayer::allocate_dma_lines(DISPLAY_WIDTH);
+            break;
+        case GifPlayer::DRAW_PRESENTER:
+            if (presenter == nullptr) {
+                // Never stopped; the process exits under it like it does under the simulated firmware
+                presenter = new PresenterTask(*GifPlayer::tft, 0);
+                presenter->begin();
+            }
+            GifPlayer::presenter = presenter;
+            break;
+        case GifPlayer::DRAW_BUFFER:
+        case GifPlayer::DRAW_BUFFER_REPAINT:
+            GifPlayer::set_frame_buffer(true);
+            GifPlayer::force_dirty = target == GifPlayer::DRAW_BUFFER_REPAINT;
+            break;
+        default:
+            break;
+    }
+    GifPlayer::scale = scale;
+    GifPlayer::select_draw_kernels();
+}
+
+// GIFDraw and GIFDrawFrameBuffer exactly as they were before 987452f split them into per-target kernels, branching on
+// the target and pixel mode for every line, with only the names changed. Unscaled only, as upscaling came later.
+
+// Draw a line of image directly on the LCD
+void KernelBench::genericDraw(GIFDRAW *pDraw)
+{
+  uint8_t *s;
+  uint16_t *d, *usPalette;
+  int x, y, iWidth, iCount;
+
+  // Displ;ay bounds chech and cropping
+  iWidth = pDraw->iWidth;
+  if (iWidth + pDraw->iX > DISPLAY_WIDTH)
+    iWidth = DISPLAY_WIDTH - pDraw->iX;
+  usPalette = pDraw->pPalette;
+  y = pDraw->iY + pDraw->y; // current line
+  if (y >= DISPLAY_HEIGHT || pDraw->iX >= DISPLAY_WIDTH || iWidth < 1)
+    return;
+  // The back buffer keeps tracking lines below max_line so they can be restored once the clip is removed
+  if (frame_buffer == nullptr && max_line > -1 && y > max_line)
+    return;
+  last_frame_stats.lines++;
+
+  // Old image disposal
+  s = pDraw->pPixels;
+  if (pDraw->ucDisposalMethod == 2) // restore to background color
+  {
+    for (x = 0; x < iWidth; x++)
+    {
+      if (s[x] == pDraw->ucTransparent)
+        s[x] = pDraw->ucBackground;
+    }
+    pDraw->ucHasTransparency = 0;
+  }
+
+  if (frame_buffer != nullptr)
+  {
+    genericDrawFrameBuffer(pDraw, iWidth, y);
+    return;
+  }
+
+  // Apply the new pixels to the main image
+  if (pDraw->ucHasTransparency) // if transparency used
+  {
+    uint8_t *pEnd = s + iWidth, ucTransparent = pDraw->ucTransparent;
+    x = 0;
+    while (s < pEnd)
+    {
+      // Skip a run of transparent pixels
+      while (s < pEnd && *s == ucTransparent)
+      {
+        s++;
+        x++;
+      }
+      // Find the following run of opaque pixels
+      uint8_t *pRun = s;
+      while (s < pEnd && *s != ucTransparent && s - pRun < BUFFER_SIZE)
+        s++;
+      iCount = s - pRun;
+      if (iCount) // any opaque pixels?
+      {
+        // DMA would degrtade performance here due to short line segments
+        {
+          CycleTimer timer(palette_cycles);
+          palette_expand(usTemp, pRun, usPalette, iCount);
+        }
+        present(pDraw->iX + x, y, iCount, 1, usTemp);
+        x += iCount;
+      }
+    }
+  }
+  else
+  {
+    s = pDraw->pPixels;
+
+    if (presenter != nullptr)
+    {
+      // Translate straight into the presenter's ring; the other core pushes it to the panel
+      PresentLine *line;
+      {
+        CycleTimer timer(push_cycles);
+        line = presenter->acquireLine();
+      }
+      {
+        CycleTimer timer(palette_cycles);
+        palette_expand(line->pixels, s, usPalette, iWidth);
+      }
+      line->x = pDraw->iX;
+      line->y = y;
+      line->width = iWidth;
+      line->height = 1;
+      capture(pDraw->iX, y, iWidth, 1, line->pixels, iWidth);
+      presenter->submitLine();
+      last_frame_stats.window_commands++;
+      last_frame_stats.pushed_bytes += iWidth * sizeof(uint16_t);
+      return;
+    }
+
+    if (dma_lines[0] != nullptr && iWidth <= dma_line_width)
+    {
+      // Translate into the next free line buffer while the previous line is still being sent, so decoding
+      // of this line overlapped the transfer of the last one
+      d = dma_lines[dma_index];
+      {
+        CycleTimer timer(palette_cycles);
+        palette_expand(d, s, usPalette, iWidth);
+      }
+      capture(pDraw->iX, y, iWidth, 1, d, iWidth);
+
+      wait_for_dma();
+      {
+        CycleTimer timer(push_cycles);
+        tft->setAddrWindow(pDraw->iX, y, iWidth, 1);
+        tft->pushPixelsDMA(d, iWidth);
+      }
+      dma_index = (dma_index + 1) % DMA_LINE_BUFFERS;
+      last_frame_stats.window_commands++;
+      last_frame_stats.pushed_bytes += iWidth * sizeof(uint16_t);
+      return;
+    }
+
+    // Translate the 8-bit pixels through the RGB565 palette (already byte reversed)
+    iCount = min(iWidth, BUFFER_SIZE);
+    {
+      CycleTimer timer(palette_cycles);
+      palette_expand(usTemp, s, usPalette, iCount);
+    }
+    s += iCount;
+
+    // 57.0 fps
+    wait_for_dma();
+    {
+      CycleTimer timer(push_cycles);
+      tft->setAddrWindow(pDraw->iX, y, iWidth, 1);
+      tft->pushPixels(usTemp, iCount);
+    }
+    capture(pDraw->iX, y, iWidth, 1, usTemp, iCount);
+    last_frame_stats.window_commands++;
+    last_frame_stats.pushed_bytes += iCount * sizeof(uint16_t);
+
+    iWidth -= iCount;
+    // Loop if pixel buffer smaller than width
+    while (iWidth > 0)
+    {
+      // Translate the 8-bit pixels through the RGB565 palette (already byte reversed)
+      iCount = min(iWidth, BUFFER_SIZE);
+      {
+        CycleTimer timer(palette_cycles);
+        palette_expand(usTemp, s, usPalette, iCount);
+      }
+      s += iCount;
+
+      {
+        CycleTimer timer(push_cycles);
+        tft->pushPixels(usTemp, iCount);
+      }
+      capture(pDraw->iX, y, 0, 0, usTemp, iCount);
+      last_frame_stats.pushed_bytes += iCount * sizeof(uint16_t);
+      iWidth -= iCount;
+    }
+  }
+} /* GIFDraw() */
+
+// Draw a line of image into the back buffer, tracking which pixels actually changed
+void KernelBench::genericDrawFrameBuffer(GIFDRAW *pDraw, int iWidth, int y)
+{
+  uint8_t *s = pDraw->pPixels;
+  uint16_t *usPalette = pDraw->pPalette;
+  uint16_t *d = &frame_buffer[y * DISPLAY_WIDTH + pDraw->iX];
+  uint8_t ucHasTransparency = pDraw->ucHasTransparency;
+  uint8_t ucTransparent = pDraw->ucTransparent;
+  int first = -1;
+  int last = -1;
+
+  {
+    CycleTimer timer(palette_cycles);
+    for (int x = 0; x < iWidth; x++)
+    {
+      uint8_t c = s[x];
+      if (ucHasTransparency && c == ucTransparent)
+        continue;
+      uint16_t color = usPalette[c];
+      if (d[x] != color || force_dirty)
+      {
+        d[x] = color;
+        if (first < 0)
+          first = x;
+        last = x;
+      }
+    }
+  }
+
+  if (first < 0)
+    return;
+  if (composite && !skip_draw && !(max_line > -1 && y > max_line))
+  {
+    // Send the changed span of this line as one transfer, with transparent pixels filled in from the shadow copy
+    present(pDraw->iX + first, y, last - first + 1, 1, &d[first]);
+  }
+  else
+  {
+    mark_dirty(pDraw->iX + first, y, pDraw->iX + last, y);
+  }
+}
+
+// Times one gif line per call through GIFDraw for every target, pixel mode and scale, and through the generic
+// path for unscaled lines. Lines alternate between two images, so the back buffer targets see changed pixels.
+bool KernelBench::run() {
+    static uint16_t palette[256];
+    // Sprite-like lines: opaque runs between transparent gaps
+    static uint8_t images[2][DISPLAY_HEIGHT][DISPLAY_WIDTH];
+    static uint8_t line[DISPLAY_WIDTH];
+    srand(2);
+    for (uint16_t& color : palette) {
+        color = rand();
+    }
+    for (auto& image : images) {
+        for (auto& row : image) {
+            for (int x = 0; x < DISPLAY_WIDTH;) {
+                bool transparent = rand() % 3 == 0;
+                for (int run = 1 + rand() % 24; run > 0 && x < DISPLAY_WIDTH; run--, x++) {
+                    row[x] = transparent ? KERNEL_BENCH_TRANSPARENT : rand() % KERNEL_BENCH_TRANSPARENT;
+                }
+            }
+        }
+    }
+
+    TFT_eSPI tft;
+    tft.begin();
+    tft.setRotation(1);
+    GifPlayer::begin(&tft);
+    tft.startWrite();
+
+    printf("\n%-16s %-12s %5s %12s %12s %8s\n", "draw target", "mode", "scale", "generic cyc", "kernel cyc", "speedup");
+    for (int target = 0; target < GifPlayer::DRAW_TARGETS; target++) {
+        for (int scale = 1; scale <= MAX_UPSCALE; scale++) {
+            bool scaled_target = target == GifPlayer::DRAW_DIRECT || target == GifPlayer::DRAW_BUFFER
+                    || target == GifPlayer::DRAW_BUFFER_REPAINT;
+            if (scale > 1 && !scaled_target) {
+                // Scaled lines always go through present(), so DMA and the presenter have no kernels of their own
+                continue;
+            }
+            for (int mode = 0; mode < GifPlayer::PIXEL_MODES; mode++) {
+                GIFDRAW draw = {};
+                draw.iWidth = DISPLAY_WIDTH / scale;
+                draw.pPalette = palette;
+                draw.pPixels = line;
+                draw.ucTransparent = KERNEL_BENCH_TRANSPARENT;
+                draw.ucHasTransparency = mode != GifPlayer::PIXELS_OPAQUE;
+                draw.ucDisposalMethod = mode == GifPlayer::PIXELS_RESTORE_BACKGROUND ? 2 : 1;
+                int rows = DISPLAY_HEIGHT / scale;
+                int call = 0;
+                // Each call draws the next line of the current image, restoring it as the restore mode edits it
+                auto drawLine = [&](void (*draw_fn)(GIFDRAW*)) {
+                    GIFDRAW next = draw;
+                    next.y = call % rows;
+                    memcpy(line, images[(call / rows) & 1][next.y], next.iWidth);
+                    call++;
+                    draw_fn(&next);
+                };
+
+                setTarget((GifPlayer::DrawTarget)target, scale);
+                double kernel = cyclesPerCall(KERNEL_BENCH_ITERATIONS, [&]() { drawLine(GifPlayer::GIFDraw); });
+                if (scale > 1) {
+                    printf("%-16s %-12s %5d %12s %12.1f %8s\n", kTargetNames[target], kModeNames[mode], scale, "-",
+                        kernel, "-");
+                    continue;
+                }
+                setTarget((GifPlayer::DrawTarget)target, scale);
+                call = 0;
+                double generic = cyclesPerCall(KERNEL_BENCH_ITERATIONS, [&]() { drawLine(genericDraw); });
+                printf("%-16s %-12s %5d %12.1f %12.1f %7.2fx\n", kTargetNames[target], kModeNames[mode], scale,
+                    generic, kernel, generic / kernel);
+            }
+        }
+    }
+    setTarget(GifPlayer::DRAW_DIRECT, 1);
+    tft.endWrite();
+    return true;
+}
+
+int runKernelBench() {
+    if (!benchPaletteExpand() || !KernelBench::run()) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+// MainTask for the simulator: no WiFi, NTP or OTA; button presses come from a script given on the command line
+
+#include "main_task.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "semaphore_guard.h"
+#include "sim.h"
+
+using namespace ace_button;
+
+struct ScriptedPress {
+    uint32_t at_ms;
+    uint8_t button_id;
+};
+
+static std::vector<ScriptedPress> scripted_presses;
+static bool christmas = false;
+
+void sim::scriptPress(uint32_t at_ms, uint8_t button_id) {
+    scripted_presses.push_back({at_ms, button_id});
+    std::stable_sort(scripted_presses.begin(), scripted_presses.end(), [](const ScriptedPress& a, const ScriptedPress& b) {
+        return a.at_ms < b.at_ms;
+    });
+}
+
+void sim::setChristmas(bool enabled) {
+    christmas = enabled;
+}
+
+MainTask::MainTask(const uint8_t task_core) : Task{"Main", 8192, 1, task_core}, semaphore_(xSemaphoreCreateMutex()) {
+    assert(semaphore_ != NULL);
+    xSemaphoreGive(semaphore_);
+}
+
+MainTask::~MainTask() {
+    if (semaphore_ != NULL) {
+        vSemaphoreDelete(semaphore_);
+    }
+}
+
+void MainTask::run() {
+    AceButton buttons[] = {
+        AceButton(0, 1, BUTTON_ID_LEFT),
+        AceButton(0, 1, BUTTON_ID_RIGHT),
+    };
+
+    size_t next_press = 0;
+    while (1) {
+        while (next_press < scripted_presses.size() && millis() >= scripted_presses[next_press].at_ms) {
+            AceButton* button = &buttons[scripted_presses[next_press].button_id];
+            log(button->getId() == BUTTON_ID_LEFT ? "Scripted press: left" : "Scripted press: right");
+            handleEvent(button, AceButton::kEventPressed, 0);
+            handleEvent(button, AceButton::kEventReleased, 1);
+            next_press++;
+        }
+        // Sleep in real time; only the display task's waits advance the virtual clock
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void MainTask::setConfig(const char* wifi_ssid, const char* wifi_password, const char* timezone) {
+    SemaphoreGuard lock(semaphore_);
+    wifi_ssid_ = String(wifi_ssid);
+    wifi_password_ = String(wifi_password);
+    timezone_ = String(timezone);
+}
+
+bool MainTask::getLocalTime(tm* t) {
+    if (!christmas) {
+        return false;
+    }
+    *t = {};
+    t->tm_year = 2021 - 1900;
+    t->tm_mon = 11;
+    t->tm_mday = 25;
+    return true;
+}
+
+void MainTask::setLogger(Logger* logger) {
+    SemaphoreGuard lock(semaphore_);
+    logger_ = logger;
+}
+
+void MainTask::setOtaEnabled(bool enabled) {
+    log(enabled ? "OTA enabled (not simulated)" : "OTA disabled");
+}
+
+void MainTask::log(const char* message) {
+    SemaphoreGuard lock(semaphore_);
+    if (logger_ != nullptr) {
+        logger_->log(message);
+    } else {
+        Serial.println(message);
+    }
+}
+
+void MainTask::log(String message) {
+    log(message.c_str());
+}
+
+void MainTask::registerEventQueue(QueueHandle_t queue) {
+    bool subscribed = event_bus_.subscribe(queue);
+    assert("Too many event queues" && subscribed);
+}
+
+void MainTask::publishEvent(Event event) {
+    event_bus_.publish(event);
+}
+
+// Scripted presses have no bounce, so they are stamped when they are handled
+void MainTask::handleEvent(AceButton* button, uint8_t event_type, uint8_t button_state) {
+    Event event = {
+        .type = EventType::BUTTON,
+        .time_us = micros(),
+        {
+            .button = {
+                .button_id = button->getId(),
+                .event = event_type,
+            },
+        }
+    };
+    publishEvent(event);
+}
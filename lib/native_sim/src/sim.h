@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+// Controls for the host simulator that have no counterpart on the device
+namespace sim {
+
+// The virtual clock is real elapsed time plus every delay() that was skipped. In realtime mode delay() sleeps
+// instead, so the simulation runs at the speed it would on the device.
+void setRealtime(bool realtime);
+bool isRealtime();
+
+// Called at the start of every delay() and timed queue wait, i.e. whenever the firmware waits for the next frame;
+// used to dump frames
+void setIdleHook(void (*hook)());
+
+uint64_t elapsedMicros();
+
+// Button presses replayed by the simulated MainTask at the given virtual time
+void scriptPress(uint32_t at_ms, uint8_t button_id);
+
+// Makes MainTask report a synced clock on Christmas day instead of no time at all
+void setChristmas(bool christmas);
+
+}
@@ -0,0 +1,174 @@
+// Entry point of the native simulator: runs MainTask and DisplayTask against a card directory on the host and
+// records what the panel shows whenever the display task waits for the next frame.
+//
+//   program --sd DIR [--frames DIR] [--hash] [--duration-ms N] [--realtime] [--press MS:left|right] [--christmas]
+//   program --bench DIR [--results FILE] [--baseline FILE [--update-baseline [--record-fps]]] [--loops N] [--fps-tolerance PCT]
+//   program --kernels
+//
+// Left out of unit test builds, which bring their own main().
+
+#ifndef PIO_UNIT_TESTING
+
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Arduino.h"
+#include "TFT_eSPI.h"
+#include "bench.h"
+#include "display_task.h"
+#include "event.h"
+#include "main_task.h"
+#include "sim.h"
+
+static std::string frames_dir;
+static bool print_hashes = false;
+static uint32_t frame_count = 0;
+static std::mutex frame_mutex;
+
+// Records the panel once per change; called at the start of every delay()
+static void captureFrame() {
+    TFT_eSPI* panel = TFT_eSPI::active();
+    if (panel == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    if (!panel->takeDirty()) {
+        return;
+    }
+    uint32_t frame = frame_count++;
+    if (print_hashes) {
+        printf("frame %u at %u ms: %08x\n", frame, millis(), panel->hash());
+    }
+    if (!frames_dir.empty()) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/frame_%06u.ppm", frames_dir.c_str(), frame);
+        if (!panel->writePpm(path)) {
+            fprintf(stderr, "Failed to write %s\n", path);
+        }
+    }
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s --sd DIR [options]\n"
+        "  --sd DIR           directory to use as the SD card (default: current directory)\n"
+        "  --frames DIR       write every displayed frame to DIR/frame_NNNNNN.ppm\n"
+        "  --hash             print a hash of every displayed frame\n"
+        "  --duration-ms N    stop after N ms of virtual time (default: 60000)\n"
+        "  --realtime         sleep through delays instead of skipping them\n"
+        "  --press MS:BUTTON  press left or right at MS ms of virtual time; may be repeated\n"
+        "  --christmas        pretend it's Christmas day\n"
+        "\n"
+        "Usage: %s --bench DIR [options]\n"
+        "  --bench DIR        play every gif in DIR in each rendering mode and report fps, bytes read and draw calls\n"
+        "  --results FILE     write the results as JSON to FILE\n"
+        "  --baseline FILE    flag cases that regressed against the results stored in FILE\n"
+        "  --update-baseline  store this run's results in the baseline file instead\n"
+        "  --record-fps       also store fps in the baseline, to compare it on this host (counts only by default)\n"
+        "  --loops N          times to play each gif (default: 5)\n"
+        "  --fps-tolerance P  allowed drop in fps, in percent (default: 10)\n"
+        "\n"
+        "Usage: %s --kernels\n"
+        "  --kernels          time the line drawing kernels against the loops they replaced\n",
+        program, program, program);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    const char* sd_dir = ".";
+    uint32_t duration_ms = 60000;
+    BenchOptions bench;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--sd" && has_value) {
+            sd_dir = argv[++i];
+        } else if (arg == "--frames" && has_value) {
+            char resolved[PATH_MAX];
+            if (realpath(argv[++i], resolved) == nullptr) {
+                fprintf(stderr, "No such directory: %s\n", argv[i]);
+                return 1;
+            }
+            frames_dir = resolved;
+        } else if (arg == "--hash") {
+            print_hashes = true;
+        } else if (arg == "--duration-ms" && has_value) {
+            duration_ms = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--realtime") {
+            sim::setRealtime(true);
+        } else if (arg == "--press" && has_value) {
+            char button[16];
+            unsigned at_ms;
+            if (sscanf(argv[++i], "%u:%15s", &at_ms, button) != 2) {
+                usage(argv[0]);
+            }
+            if (strcmp(button, "left") == 0) {
+                sim::scriptPress(at_ms, BUTTON_ID_LEFT);
+            } else if (strcmp(button, "right") == 0) {
+                sim::scriptPress(at_ms, BUTTON_ID_RIGHT);
+            } else {
+                usage(argv[0]);
+            }
+        } else if (arg == "--christmas") {
+            sim::setChristmas(true);
+        } else if (arg == "--kernels") {
+            return runKernelBench();
+        } else if (arg == "--bench" && has_value) {
+            bench.corpus_dir = argv[++i];
+        } else if (arg == "--results" && has_value) {
+            bench.results_path = argv[++i];
+        } else if (arg == "--baseline" && has_value) {
+            bench.baseline_path = argv[++i];
+        } else if (arg == "--update-baseline") {
+            bench.update_baseline = true;
+        } else if (arg == "--record-fps") {
+            bench.record_fps = true;
+        } else if (arg == "--loops" && has_value) {
+            bench.loops = max(1, atoi(argv[++i]));
+        } else if (arg == "--fps-tolerance" && has_value) {
+            bench.fps_tolerance_percent = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (!bench.corpus_dir.empty()) {
+        if (bench.update_baseline && bench.baseline_path.empty()) {
+            usage(argv[0]);
+        }
+        return runBench(bench);
+    }
+
+    // The firmware is built with the card mounted at ".", so the card directory becomes the working directory
+    if (chdir(sd_dir) != 0) {
+        fprintf(stderr, "No such directory: %s\n", sd_dir);
+        return 1;
+    }
+    sim::setIdleHook(captureFrame);
+
+    static MainTask main_task(0);
+    static DisplayTask display_task(main_task, 1);
+    main_task.begin();
+    display_task.begin();
+
+    while (millis() < duration_ms) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(frame_mutex);
+        fprintf(stderr, "Simulated %u ms in %u ms, %u frames\n", millis(), (uint32_t)(sim::elapsedMicros() / 1000),
+            frame_count);
+        fflush(stdout);
+    }
+    // The tasks never return, so leave without running destructors under them
+    _exit(0);
+}
+
+#endif  // PIO_UNIT_TESTING
@@ -0,0 +1,221 @@
+#include "anim_player.h"
+
+#include <SD_MMC.h>
+#include <TFT_eSPI.h>
+
+#include "overlay.h"
+
+#define ANIM_MAGIC "SOA1"
+#define ANIM_FILL_FLAG 0x8000
+
+TFT_eSPI* AnimPlayer::tft;
+File AnimPlayer::file;
+PrefetchTask* AnimPlayer::prefetcher = nullptr;
+
+uint8_t AnimPlayer::io_buffer[ANIM_IO_BUFFER_SIZE];
+size_t AnimPlayer::io_pos;
+size_t AnimPlayer::io_len;
+uint16_t AnimPlayer::pixels[BUFFER_SIZE];
+
+uint16_t AnimPlayer::width;
+uint16_t AnimPlayer::height;
+uint16_t AnimPlayer::frame_count;
+uint16_t AnimPlayer::frame_index;
+OverlayWindow AnimPlayer::overlay_window;
+
+GifPlayer::FrameStats AnimPlayer::last_frame_stats;
+GifPlayer::FrameStats AnimPlayer::total_stats;
+uint32_t AnimPlayer::frame_start_us;
+
+// Buffered read; the file is consumed in large sequential chunks rather than per span
+bool AnimPlayer::read(void* dst, size_t len) {
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    while (len > 0) {
+        if (io_pos == io_len) {
+            io_len = file.read(io_buffer, sizeof(io_buffer));
+            io_pos = 0;
+            if (io_len == 0) {
+                return false;
+            }
+        }
+        size_t n = min(len, io_len - io_pos);
+        memcpy(out, &io_buffer[io_pos], n);
+        io_pos += n;
+        out += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool AnimPlayer::skip(uint32_t len) {
+    size_t buffered = min((size_t)len, io_len - io_pos);
+    io_pos += buffered;
+    len -= buffered;
+    return len == 0 || file.seek(len, fs::SeekCur);
+}
+
+// Draws the next span of the frame, checking it against the anim's size and the frame_bytes left in the frame
+AnimPlayer::SpanResult AnimPlayer::play_span(uint32_t* frame_bytes) {
+    uint16_t header[4];
+    if (*frame_bytes < sizeof(header)) {
+        return SpanResult::INVALID;
+    }
+    if (!read(header, sizeof(header))) {
+        return SpanResult::TRUNCATED;
+    }
+    *frame_bytes -= sizeof(header);
+    uint16_t x = header[0];
+    uint16_t y = header[1];
+    bool fill = header[2] & ANIM_FILL_FLAG;
+    uint16_t w = header[2] & ~ANIM_FILL_FLAG;
+    uint16_t h = header[3];
+
+    uint32_t remaining = (uint32_t)w * h;
+    uint32_t data_bytes = fill ? sizeof(uint16_t) : remaining * sizeof(uint16_t);
+    if (x + w > width || y + h > height || data_bytes > *frame_bytes) {
+        return SpanResult::INVALID;
+    }
+    *frame_bytes -= data_bytes;
+    if (remaining > 0) {
+        tft->setAddrWindow(x, y, w, h);
+        overlay_window.begin(x, y, w, h);
+        if (last_frame_stats.window_commands++ == 0) {
+            last_frame_stats.first_push_us = micros() - frame_start_us;
+        }
+        last_frame_stats.pushed_bytes += remaining * sizeof(uint16_t);
+    }
+
+    if (fill) {
+        // Stored in panel byte order, like the pixels
+        uint16_t color;
+        if (!read(&color, sizeof(color))) {
+            return SpanResult::TRUNCATED;
+        }
+        overlay_window.pushBlock(color, remaining);
+        return SpanResult::DRAWN;
+    }
+
+    while (remaining > 0) {
+        uint32_t n = min(remaining, (uint32_t)BUFFER_SIZE);
+        if (!read(pixels, n * sizeof(uint16_t))) {
+            return SpanResult::TRUNCATED;
+        }
+        overlay_window.pushPixels(pixels, n);
+        remaining -= n;
+    }
+    return SpanResult::DRAWN;
+}
+
+bool AnimPlayer::start(const char* path) {
+    io_pos = 0;
+    io_len = 0;
+    // A prefetched anim comes with its first chunk already in the read buffer
+    if (prefetcher == nullptr || !prefetcher->take(path, &file, io_buffer, sizeof(io_buffer), &io_len)) {
+        file = SD_MMC.open(path);
+    }
+    if (!file) {
+        log_n("Could not open anim %s", path);
+        return false;
+    }
+
+    uint8_t magic[4];
+    uint16_t header[4];
+    if (!read(magic, sizeof(magic)) || memcmp(magic, ANIM_MAGIC, sizeof(magic)) != 0 || !read(header, sizeof(header))
+            || header[0] == 0 || header[0] > DISPLAY_WIDTH || header[1] == 0 || header[1] > DISPLAY_HEIGHT) {
+        log_n("Invalid anim %s", path);
+        file.close();
+        return false;
+    }
+    width = header[0];
+    height = header[1];
+    frame_count = header[2];
+    frame_index = 0;
+    total_stats = {};
+
+    tft->startWrite();
+    return true;
+}
+
+bool AnimPlayer::play_frame(int* frame_delay) {
+    last_frame_stats = {};
+    uint32_t render_start = micros();
+    frame_start_us = render_start;
+
+    // Lines the overlay was set on or removed from; what the anim drew there before is unknown
+    int y0, y1;
+    if (Overlay::take_changed_lines(&y0, &y1)) {
+        Overlay::paint(tft, y0, y1);
+    }
+
+    uint16_t header[2];
+    uint32_t span_bytes;
+    if (frame_index >= frame_count || !read(header, sizeof(header)) || !read(&span_bytes, sizeof(span_bytes))) {
+        return false;
+    }
+    uint16_t delay_ms = header[0];
+    uint16_t span_count = header[1];
+
+    uint32_t frame_bytes = span_bytes;
+    for (uint16_t i = 0; i < span_count; i++) {
+        SpanResult result = play_span(&frame_bytes);
+        if (result == SpanResult::TRUNCATED) {
+            log_n("Truncated anim frame %u", frame_index);
+            return false;
+        }
+        if (result == SpanResult::INVALID) {
+            log_n("Skipping invalid span %u of anim frame %u", i, frame_index);
+            break;
+        }
+    }
+    // Whatever is left of span_bytes belongs to spans that weren't drawn; the next frame starts after it
+    if (!skip(frame_bytes)) {
+        log_n("Truncated anim frame %u", frame_index);
+        return false;
+    }
+    frame_index++;
+
+    last_frame_stats.frames = 1;
+    last_frame_stats.render_us = micros() - render_start;
+    total_stats.frames++;
+    total_stats.window_commands += last_frame_stats.window_commands;
+    total_stats.pushed_bytes += last_frame_stats.pushed_bytes;
+    total_stats.render_us += last_frame_stats.render_us;
+
+    if (frame_delay == nullptr) {
+        uint32_t elapsed = last_frame_stats.render_us / 1000;
+        if (elapsed < delay_ms) {
+            delay(delay_ms - elapsed);
+        }
+    } else {
+        *frame_delay = delay_ms;
+    }
+    return frame_index < frame_count;
+}
+
+void AnimPlayer::stop() {
+    file.close();
+    tft->endWrite();
+}
+
+void AnimPlayer::begin(TFT_eSPI* tft) {
+    AnimPlayer::tft = tft;
+    overlay_window.setTft(tft);
+}
+
+void AnimPlayer::set_prefetcher(PrefetchTask* prefetcher) {
+    AnimPlayer::prefetcher = prefetcher;
+}
+
+void AnimPlayer::prefetch(const char* path) {
+    if (prefetcher != nullptr) {
+        prefetcher->request(path, ANIM_IO_BUFFER_SIZE);
+    }
+}
+
+GifPlayer::FrameStats AnimPlayer::get_last_frame_stats() {
+    return last_frame_stats;
+}
+
+GifPlayer::FrameStats AnimPlayer::get_stats() {
+    return total_stats;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SD_MMC.h>
+#include <TFT_eSPI.h>
+
+#include "gif_player.h"
+#include "overlay.h"
+#include "prefetch_task.h"
+
+#define ANIM_IO_BUFFER_SIZE 4096
+
+// Plays .anim files produced by tools/gif2anim.py. These are gifs pre-transcoded into delta-coded RGB565
+// rectangles (literal or solid fill) with per-frame timing, so playback is a stream copy from the SD card to the
+// panel with no LZW decode.
+//
+// File layout (little-endian):
+//   header: "SOA1", u16 width, u16 height, u16 frame_count, u16 reserved
+//   frame:  u16 delay_ms, u16 span_count, u32 span_bytes, then span_count spans
+//   span:   u16 x, u16 y, u16 w (bit 15 set for a solid fill), u16 h, then one pixel for a fill or w*h pixels
+// Pixels are RGB565 stored high byte first, matching AnimatedGIF's BIG_ENDIAN_PIXELS palette.
+// span_bytes counts the spans of the frame. A span reaching outside the anim's width and height, or past span_bytes,
+// means the file is corrupt or was made for another panel; the rest of that frame is skipped using span_bytes.
+class AnimPlayer {
+    private:
+        static TFT_eSPI* tft;
+        static File file;
+        static PrefetchTask* prefetcher;
+
+        static uint8_t io_buffer[ANIM_IO_BUFFER_SIZE];
+        static size_t io_pos;
+        static size_t io_len;
+        static uint16_t pixels[BUFFER_SIZE];
+
+        static uint16_t width;
+        static uint16_t height;
+        static uint16_t frame_count;
+        static uint16_t frame_index;
+        // Spans are streamed through this so lines under the overlay get blended
+        static OverlayWindow overlay_window;
+
+        static GifPlayer::FrameStats last_frame_stats;
+        static GifPlayer::FrameStats total_stats;
+        static uint32_t frame_start_us;
+
+        enum class SpanResult : uint8_t {
+            DRAWN,
+            INVALID,    // header read, nothing drawn
+            TRUNCATED,
+        };
+
+        static bool read(void* dst, size_t len);
+        static bool skip(uint32_t len);
+        static SpanResult play_span(uint32_t* frame_bytes);
+
+    public:
+        static void begin(TFT_eSPI* tft);
+        // Open anims through prefetcher when it has them ready; pass nullptr to always open from the card
+        static void set_prefetcher(PrefetchTask* prefetcher);
+        // Have the prefetcher open path ahead of its start()
+        static void prefetch(const char* path);
+
+        static bool start(const char* path);
+        static bool play_frame(int* frame_delay);
+        static void stop();
+
+        static GifPlayer::FrameStats get_last_frame_stats();
+        static GifPlayer::FrameStats get_stats();
+};
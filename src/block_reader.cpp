@@ -0,0 +1,164 @@
+#include "block_reader.h"
+
+BlockReader::~BlockReader() {
+    close();
+    free(buffer_);
+}
+
+bool BlockReader::setBlockSize(size_t block_size) {
+    if (block_size == 0 || block_size % 512 != 0) {
+        return false;
+    }
+    uint8_t* buffer = static_cast<uint8_t*>(malloc(block_size * READ_CACHE_BLOCKS));
+    if (buffer == nullptr) {
+        log_n("Failed to allocate %u byte read cache", (unsigned)(block_size * READ_CACHE_BLOCKS));
+        return false;
+    }
+    free(buffer_);
+    buffer_ = buffer;
+    block_size_ = block_size;
+    for (int i = 0; i < READ_CACHE_BLOCKS; i++) {
+        blocks_[i] = {0, 0, 0, &buffer_[i * block_size]};
+    }
+    return true;
+}
+
+bool BlockReader::open(fs::FS& fs, const char* path) {
+    if (buffer_ == nullptr && !setBlockSize(DEFAULT_READ_BLOCK_SIZE)) {
+        return false;
+    }
+    close();
+    file_ = fs.open(path);
+    if (!file_) {
+        return false;
+    }
+    fs_ = &fs;
+    path_ = path;
+    size_ = file_.size();
+    position_ = 0;
+    file_position_ = 0;
+    for (int i = 0; i < READ_CACHE_BLOCKS; i++) {
+        blocks_[i].length = 0;
+    }
+    resetStats();
+    return true;
+}
+
+bool BlockReader::adopt(fs::FS& fs, const char* path, File file, const uint8_t* head, int32_t head_len) {
+    if (buffer_ == nullptr && !setBlockSize(DEFAULT_READ_BLOCK_SIZE)) {
+        return false;
+    }
+    close();
+    file_ = file;
+    fs_ = &fs;
+    path_ = path;
+    size_ = file_.size();
+    position_ = 0;
+    file_position_ = head_len;
+    resetStats();
+
+    // Seed the cache with the whole blocks of the head (or the final partial block) so the first reads are hits
+    int32_t offset = 0;
+    for (int i = 0; i < READ_CACHE_BLOCKS; i++) {
+        Block& block = blocks_[i];
+        int32_t n = min((int32_t)block_size_, head_len - offset);
+        block.length = 0;
+        if (n > 0 && (n == (int32_t)block_size_ || offset + n == size_)) {
+            memcpy(block.data, &head[offset], n);
+            block.start = offset;
+            block.length = n;
+            block.last_used = ++use_counter_;
+            offset += n;
+        }
+    }
+    return true;
+}
+
+void BlockReader::close() {
+    if (file_) {
+        file_.close();
+    }
+}
+
+int32_t BlockReader::read(uint8_t* dst, int32_t len) {
+    len = min(len, size_ - position_);
+    int32_t total = 0;
+    while (len > 0) {
+        Block* block = lookup(position_);
+        if (block == nullptr) {
+            break;
+        }
+        int32_t offset = position_ - block->start;
+        int32_t n = min(len, block->length - offset);
+        memcpy(dst, &block->data[offset], n);
+        dst += n;
+        len -= n;
+        total += n;
+        position_ += n;
+    }
+    return total;
+}
+
+void BlockReader::seek(int32_t position) {
+    // Only moves the logical position; the card is touched when a read misses the cache
+    position_ = constrain(position, 0, size_);
+}
+
+BlockReader::Block* BlockReader::lookup(int32_t position) {
+    Block* victim = &blocks_[0];
+    for (int i = 0; i < READ_CACHE_BLOCKS; i++) {
+        Block& block = blocks_[i];
+        if (position >= block.start && position < block.start + block.length) {
+            stats_.hits++;
+            block.last_used = ++use_counter_;
+            return &block;
+        }
+        // Empty blocks count as least recently used, so they are filled before any block holding data is evicted
+        uint32_t last_used = block.length > 0 ? block.last_used : 0;
+        uint32_t victim_last_used = victim->length > 0 ? victim->last_used : 0;
+        if (last_used < victim_last_used) {
+            victim = &block;
+        }
+    }
+
+    stats_.misses++;
+    int32_t start = position - (position % block_size_);
+    if (!fill(*victim, start)) {
+        return nullptr;
+    }
+    victim->last_used = ++use_counter_;
+    return victim;
+}
+
+bool BlockReader::fill(Block& block, int32_t start) {
+    block.length = 0;
+    if (start != file_position_ && !seekFile(start)) {
+        return false;
+    }
+    int32_t len = min((int32_t)block_size_, size_ - start);
+    // Reading right up to EOF is fine here: seekFile() recovers if the file refuses to seek afterwards
+    int32_t n = file_.read(block.data, len);
+    if (n <= 0) {
+        return false;
+    }
+    stats_.sd_bytes += n;
+    block.start = start;
+    block.length = n;
+    file_position_ = start + n;
+    return true;
+}
+
+bool BlockReader::seekFile(int32_t position) {
+    uint32_t start = micros();
+    stats_.seeks++;
+    bool ok = file_.seek(position) && (int32_t)file_.position() == position;
+    if (!ok && fs_ != nullptr) {
+        // Some SD drivers won't seek once the end of the file was reached; reopening clears that state
+        file_.close();
+        file_ = fs_->open(path_.c_str());
+        ok = file_ && file_.seek(position);
+    }
+    stats_.seek_us += micros() - start;
+    file_position_ = ok ? position : -1;
+    return ok;
+}
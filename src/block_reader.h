@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#define READ_CACHE_BLOCKS 2
+#define DEFAULT_READ_BLOCK_SIZE 4096
+
+// Read-only file wrapper that serves small reads and short seeks from a few cached, block-aligned chunks of the
+// file. Each miss is a single large sequential read from the card, which is far cheaper than many small reads.
+class BlockReader {
+    public:
+        struct Stats {
+            uint32_t hits;
+            uint32_t misses;
+            uint32_t sd_bytes;  // bytes actually read from the card
+            uint32_t seeks;     // physical seeks on the card
+            uint32_t seek_us;
+        };
+
+        BlockReader() {};
+        ~BlockReader();
+        BlockReader(BlockReader const&)=delete;
+        BlockReader& operator=(BlockReader const&)=delete;
+
+        // Block size in bytes; should be a multiple of the 512-byte sector size. Drops any cached data.
+        bool setBlockSize(size_t block_size);
+        // The block size in use, or the one the first open() will use
+        size_t blockSize() const { return block_size_ > 0 ? block_size_ : DEFAULT_READ_BLOCK_SIZE; }
+
+        bool open(fs::FS& fs, const char* path);
+        // Like open(), for a file that is already open and whose first head_len bytes were read into head
+        bool adopt(fs::FS& fs, const char* path, File file, const uint8_t* head, int32_t head_len);
+        void close();
+
+        int32_t read(uint8_t* dst, int32_t len);
+        void seek(int32_t position);
+        int32_t position() const { return position_; }
+        int32_t size() const { return size_; }
+
+        Stats getStats() const { return stats_; }
+        void resetStats() { stats_ = {}; }
+
+    private:
+        struct Block {
+            int32_t start;
+            int32_t length;
+            uint32_t last_used;
+            uint8_t* data;
+        };
+
+        Block* lookup(int32_t position);
+        bool fill(Block& block, int32_t start);
+        bool seekFile(int32_t position);
+
+        fs::FS* fs_ = nullptr;
+        String path_;
+        File file_;
+        int32_t size_ = 0;
+        int32_t position_ = 0;
+        int32_t file_position_ = 0;
+
+        size_t block_size_ = 0;
+        uint8_t* buffer_ = nullptr;
+        Block blocks_[READ_CACHE_BLOCKS] = {};
+        uint32_t use_counter_ = 0;
+
+        Stats stats_ = {};
+};
@@ -0,0 +1,63 @@
+#include "boot_timeline.h"
+
+#define TIMELINE_BAR_WIDTH 40
+
+void BootTimeline::begin(BootPhase phase) {
+    Span& span = spans_[(int)phase];
+    span.start_ms = millis();
+    span.started = true;
+}
+
+void BootTimeline::end(BootPhase phase) {
+    Span& span = spans_[(int)phase];
+    span.end_ms = millis();
+    span.ended = true;
+}
+
+void BootTimeline::record(BootPhase phase, uint32_t start_ms, uint32_t end_ms) {
+    spans_[(int)phase] = {start_ms, end_ms, true, true};
+}
+
+uint32_t BootTimeline::totalMillis() const {
+    uint32_t total = 0;
+    for (const Span& span : spans_) {
+        if (span.ended) {
+            total = max(total, span.end_ms);
+        }
+    }
+    return total;
+}
+
+void BootTimeline::print(Print& out) const {
+    uint32_t total = max(totalMillis(), (uint32_t)1);
+    out.printf("Boot timeline (ms since power on):\n");
+    for (int i = 0; i < (int)BootPhase::COUNT; i++) {
+        const Span& span = spans_[i];
+        if (!span.started || !span.ended) {
+            continue;
+        }
+        char bar[TIMELINE_BAR_WIDTH + 1];
+        int first = span.start_ms * TIMELINE_BAR_WIDTH / total;
+        int last = max(first, (int)((span.end_ms * TIMELINE_BAR_WIDTH - 1) / total));
+        for (int c = 0; c < TIMELINE_BAR_WIDTH; c++) {
+            bar[c] = (c >= first && c <= last) ? '#' : '.';
+        }
+        bar[TIMELINE_BAR_WIDTH] = '\0';
+        out.printf("  %-13s %6u - %6u %6u ms |%s|\n", name((BootPhase)i), span.start_ms, span.end_ms,
+            span.end_ms - span.start_ms, bar);
+    }
+}
+
+const char* BootTimeline::name(BootPhase phase) {
+    static const char* const names[] = {
+        "sd_mount",
+        "update_check",
+        "library_scan",
+        "config",
+        "wifi_settle",
+        "player_setup",
+        "boot_gif",
+        "first_gif",
+    };
+    return names[(size_t)phase];
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+
+enum class BootPhase : uint8_t {
+    SD_MOUNT,
+    UPDATE_CHECK,
+    LIBRARY_SCAN,   // index load, folder scan and index save, on the other core
+    CONFIG,
+    WIFI_SETTLE,    // from handing the wifi config to MainTask until the backlight may come on
+    PLAYER_SETUP,
+    BOOT_GIF,
+    FIRST_GIF,      // from the end of boot until the first frame of the first chosen gif is drawn
+    COUNT,
+};
+
+// Start and end times of each startup phase, in milliseconds since power on. Phases overlap when they run on
+// different tasks; each one is written by a single task and read once boot is over.
+class BootTimeline {
+    public:
+        void begin(BootPhase phase);
+        void end(BootPhase phase);
+        void record(BootPhase phase, uint32_t start_ms, uint32_t end_ms);
+
+        // End of the last phase, i.e. time to the first main gif once FIRST_GIF has ended
+        uint32_t totalMillis() const;
+
+        // Writes one line per phase with a bar showing when it ran
+        void print(Print& out) const;
+
+        static const char* name(BootPhase phase);
+
+    private:
+        struct Span {
+            uint32_t start_ms;
+            uint32_t end_ms;
+            bool started;
+            bool ended;
+        };
+        Span spans_[(int)BootPhase::COUNT] = {};
+};
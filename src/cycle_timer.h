@@ -0,0 +1,19 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Adds the CPU cycles spent in the enclosing scope to a counter. Reading the cycle count register is far cheaper
+// than micros(), so this is suitable for per-line measurements.
+class CycleTimer {
+    public:
+        CycleTimer(uint32_t& counter) : counter_{counter}, start_{ESP.getCycleCount()} {}
+        ~CycleTimer() {
+            counter_ += ESP.getCycleCount() - start_;
+        }
+        CycleTimer(CycleTimer const&)=delete;
+        CycleTimer& operator=(CycleTimer const&)=delete;
+
+    private:
+        uint32_t& counter_;
+        uint32_t start_;
+};
@@ -0,0 +1,43 @@
+#include "decode_task.h"
+
+DecodeTask::DecodeTask(const uint8_t task_core) :
+        Task{"Decode", 8192, 1, task_core}, resume_(xSemaphoreCreateBinary()), paused_(xSemaphoreCreateBinary()) {
+    assert(resume_ != NULL && paused_ != NULL);
+}
+
+DecodeTask::~DecodeTask() {
+    vSemaphoreDelete(resume_);
+    vSemaphoreDelete(paused_);
+}
+
+void DecodeTask::run() {
+    while (1) {
+        xSemaphoreTake(resume_, portMAX_DELAY);
+        result_ = decode_(&delay_ms_);
+        done_ = true;
+        xSemaphoreGive(paused_);
+    }
+}
+
+bool DecodeTask::resume(DecodeFunction decode, uint32_t budget_us, int max_lines) {
+    if (done_) {
+        decode_ = decode;
+        done_ = false;
+    }
+    budget_us_ = budget_us;
+    max_lines_ = max_lines;
+    lines_ = 0;
+    slice_start_us_ = micros();
+    xSemaphoreGive(resume_);
+    xSemaphoreTake(paused_, portMAX_DELAY);
+    return done_;
+}
+
+void DecodeTask::checkpoint() {
+    // Every slice draws at least one line, so a frame always makes progress
+    if (lines_ > 0 && ((max_lines_ > 0 && lines_ >= max_lines_) || micros() - slice_start_us_ >= budget_us_)) {
+        xSemaphoreGive(paused_);
+        xSemaphoreTake(resume_, portMAX_DELAY);
+    }
+    lines_++;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "task.h"
+
+// Runs a frame decode on a stack of its own so that it can be suspended part way through: AnimatedGIF decodes a
+// whole frame per call, so the decode instead pauses in its draw callback, at checkpoint(), once the caller's slice
+// of lines or time is used up, and continues from there at the next resume(). The caller and this task hand control
+// back and forth and never run at the same time, so the decoder's state needs no locking.
+class DecodeTask : public Task<DecodeTask> {
+    friend class Task<DecodeTask>; // Allow base Task to invoke protected run()
+
+    public:
+        // Decodes one frame, returning like AnimatedGIF::playFrame
+        typedef int (*DecodeFunction)(int* delay_ms);
+
+        DecodeTask(const uint8_t task_core);
+        virtual ~DecodeTask();
+
+        // Caller side: starts decoding a frame with decode, or continues the one in progress, and blocks until the
+        // decode has run for budget_us or max_lines draw callbacks (0 for no limit). Returns true once the frame is
+        // done, after which result() and delayMs() describe it.
+        bool resume(DecodeFunction decode, uint32_t budget_us, int max_lines);
+
+        // Decoder side, from the draw callback before each line: pauses if the slice is used up
+        void checkpoint();
+
+        int result() const { return result_; }
+        int delayMs() const { return delay_ms_; }
+
+    protected:
+        void run();
+
+    private:
+        SemaphoreHandle_t resume_;
+        SemaphoreHandle_t paused_;
+
+        DecodeFunction decode_ = nullptr;
+        bool done_ = true;
+        int result_ = 0;
+        int delay_ms_ = 0;
+
+        uint32_t slice_start_us_ = 0;
+        uint32_t budget_us_ = 0;
+        int max_lines_ = 0;
+        int lines_ = 0;
+};
@@ -8,52 +8,31 @@
 
 #include <json11.hpp>
 
+#include "anim_player.h"
 #include "gif_player.h"
+#include "overlay.h"
 
 using namespace json11;
 
 #define PIN_LCD_BACKLIGHT 27
 
+#ifndef SD_MOUNT_POINT
+#define SD_MOUNT_POINT "/sdcard"  // The native simulator mounts its card directory at "." instead
+#endif
+#define INDEX_SAVE_INTERVAL_MS (5 * 60 * 1000)
+#define WIFI_SETTLE_MS 500         // Wifi startup current peak; the backlight stays off until it has passed
+#define EVENT_WAIT_MAX_MS 100      // Longest wait for input, so the log bar and christmas check still run between long frames
+
 #define PIN_SD_DAT1 4
 #define PIN_SD_DAT2 12
 
-DisplayTask::DisplayTask(MainTask& main_task, const uint8_t task_core) : Task{"Display", 8192, 1, task_core}, Logger(), main_task_(main_task) {
-    log_queue_ = xQueueCreate(10, sizeof(std::string *));
-    assert(log_queue_ != NULL);
-
+DisplayTask::DisplayTask(MainTask& main_task, const uint8_t task_core) : Task{"Display", 8192, 1, task_core}, Logger(), main_task_(main_task),
+        presenter_task_(tft_, task_core == 0 ? 1 : 0), decode_task_(task_core), prefetch_task_(task_core == 0 ? 1 : 0),
+        library_scan_task_(gif_index_, SD_MOUNT_POINT, task_core == 0 ? 1 : 0) {
     event_queue_ = xQueueCreate(10, sizeof(Event));
     assert(event_queue_ != NULL);
 }
 
-int DisplayTask::enumerateGifs(const char* basePath, std::vector<std::string>& out_files) {
-    int amount = 0;
-    File GifRootFolder = SD_MMC.open(basePath);
-    if(!GifRootFolder){
-        log_n("Failed to open directory");
-        return 0;
-    }
-
-    if(!GifRootFolder.isDirectory()){
-        log_n("Not a directory");
-        return 0;
-    }
-
-    File file = GifRootFolder.openNextFile();
-
-    while( file ) {
-        if(!file.isDirectory()) {
-            out_files.push_back( file.name() );
-            amount++;
-            file.close();
-        }
-        file = GifRootFolder.openNextFile();
-    }
-    GifRootFolder.close();
-    log_n("Found %d GIF files", amount);
-    return amount;
-}
-
-
 // perform the actual update from a given stream
 bool DisplayTask::performUpdate(Stream &updateSource, size_t updateSize) {
    if (Update.begin(updateSize)) {      
@@ -137,19 +116,17 @@ bool DisplayTask::updateFromFS(fs::FS &fs) {
 }
 
 void DisplayTask::run() {
+    boot_timeline_.begin(BootPhase::SD_MOUNT);
     pinMode(PIN_LCD_BACKLIGHT, OUTPUT);
     pinMode(PIN_SD_DAT1, INPUT_PULLUP);
     pinMode(PIN_SD_DAT2, INPUT_PULLUP);
 
     tft_.begin();
-#ifdef USE_DMA
-    tft_.initDMA();
-#endif
     tft_.setRotation(1);
     tft_.fillScreen(TFT_BLACK);
 
     bool isblinked = false;
-    while(! SD_MMC.begin("/sdcard", false) ) {
+    while(! SD_MMC.begin(SD_MOUNT_POINT, false) ) {
         digitalWrite(PIN_LCD_BACKLIGHT, HIGH);
         log_n("SD Card mount failed!");
         isblinked = !isblinked;
@@ -165,22 +142,31 @@ void DisplayTask::run() {
     }
 
     log_n("SD Card mounted!");
+    boot_timeline_.end(BootPhase::SD_MOUNT);
 
+    boot_timeline_.begin(BootPhase::UPDATE_CHECK);
     if (updateFromFS(SD_MMC)) {
         ESP.restart();
     }
+    boot_timeline_.end(BootPhase::UPDATE_CHECK);
 
     // #####################################################
     // CHANGES ABOVE THIS LINE MAY BREAK FIRMWARE UPDATES!!!
     // #####################################################
 
+    // Scan the library on the other core while the config is read and the boot gif plays
+    library_scan_task_.addLibrary("/gifs/main", &main_gifs_);
+    library_scan_task_.addLibrary("/gifs/christmas", &christmas_gifs_);
+    library_scan_task_.begin();
+
+    boot_timeline_.begin(BootPhase::CONFIG);
     main_task_.setLogger(this);
 
     // Load config from SD card
     File configFile = SD_MMC.open("/config.json");
     if (configFile) {
         if(configFile.isDirectory()){
-            log("Error, config.json is not a file");
+            log(LogSeverity::ERROR, "Error, config.json is not a file");
         } else {
             char data[512];
             size_t data_len = configFile.readBytes(data, sizeof(data) - 1);
@@ -190,6 +176,31 @@ void DisplayTask::run() {
             Json json = Json::parse(data, err);
             if (err.empty()) {
                 show_log_ = json["show_log"].bool_value();
+                frame_buffer_ = json["frame_buffer"].bool_value();
+                composite_ = json["composite"].bool_value();
+                upscale_ = json["upscale"].bool_value();
+                main_order_policy_ = parseOrder(json["main_order"].string_value(), PlaylistOrder::SHUFFLE);
+                christmas_order_policy_ = parseOrder(json["christmas_order"].string_value(), PlaylistOrder::SEQUENTIAL);
+                if (json["shuffle_history"].is_number()) {
+                    shuffle_history_ = constrain(json["shuffle_history"].int_value(), 0, SHUFFLE_MAX_HISTORY);
+                }
+                for (const auto& weight : json["weights"].object_items()) {
+                    gif_weights_[weight.first] = constrain(weight.second.int_value(), 1, SHUFFLE_MAX_WEIGHT);
+                }
+                std::string frame_policy = json["frame_policy"].string_value();
+                if (frame_policy == "drop") {
+                    frame_scheduler_.setPolicy(FramePolicy::DROP);
+                } else if (frame_policy == "resync") {
+                    frame_scheduler_.setPolicy(FramePolicy::RESYNC);
+                }
+                dma_ = json["dma"].bool_value();
+                split_decode_ = json["split_decode"].bool_value();
+                decode_slice_us_ = max(json["decode_slice_us"].int_value(), 0);
+                read_block_size_ = json["read_block_size"].int_value();
+                gif_cache_kb_ = json["gif_cache_kb"].int_value();
+                gif_cache_max_file_kb_ = json["gif_cache_max_file_kb"].int_value();
+                frame_cache_kb_ = json["frame_cache_kb"].int_value();
+                perf_log_interval_ms_ = json["perf_log_s"].int_value() * 1000;
                 const char* ssid = json["ssid"].string_value().c_str();
                 const char* password = json["password"].string_value().c_str();
                 Serial.printf("Wifi info: %s %s\n", ssid, password);
@@ -198,55 +209,146 @@ void DisplayTask::run() {
                 Serial.printf("Timezone: %s\n", tz);
 
                 main_task_.setConfig(ssid, password, tz);
+                wifi_settling_ = true;
+                wifi_settle_start_millis_ = millis();
+                boot_timeline_.begin(BootPhase::WIFI_SETTLE);
             } else {
-                log("Error parsing wifi credentials! " + String(err.c_str()));
+                log(LogSeverity::ERROR, "Error parsing wifi credentials! " + String(err.c_str()));
             }
         }
         configFile.close();
     } else {
-        log("Missing config file!");
+        log(LogSeverity::ERROR, "Missing config file!");
     }
 
-    // Delay to avoid brownout while wifi is starting
-    delay(500);
+    boot_timeline_.end(BootPhase::CONFIG);
 
+    boot_timeline_.begin(BootPhase::PLAYER_SETUP);
+    if (show_log_ && log_bar_.createSprite(DISPLAY_WIDTH, LOG_BAR_HEIGHT) == nullptr) {
+        show_log_ = false;
+        log(LogSeverity::WARNING, "Log bar unavailable");
+    }
     GifPlayer::begin(&tft_);
-
-    if (GifPlayer::start("/gifs/boot.gif")) {
-        GifPlayer::play_frame(nullptr);
+    AnimPlayer::begin(&tft_);
+    if (frame_buffer_ && !GifPlayer::set_frame_buffer(true)) {
+        log(LogSeverity::WARNING, "Frame buffer unavailable, drawing directly");
+    } else if (!frame_buffer_ && composite_ && !GifPlayer::set_composite(true)) {
+        log(LogSeverity::WARNING, "Composite buffer unavailable, drawing directly");
+    }
+    GifPlayer::set_upscale(upscale_);
+    if (dma_ && !GifPlayer::set_dma(true)) {
+        log(LogSeverity::WARNING, "DMA unavailable, using blocking transfers");
+    }
+    if (read_block_size_ > 0 && !GifPlayer::set_read_block_size(read_block_size_)) {
+        log(LogSeverity::WARNING, "Invalid read_block_size, using default");
+    }
+    if (gif_cache_kb_ > 0) {
+        GifPlayer::set_cache(gif_cache_kb_ * 1024, (gif_cache_max_file_kb_ > 0 ? gif_cache_max_file_kb_ : gif_cache_kb_) * 1024);
+    }
+    if (frame_cache_kb_ > 0) {
+        GifPlayer::set_frame_cache(frame_cache_kb_ * 1024);
+    }
+    if (split_decode_) {
+        // Decode on this core, push lines to the panel from the other one
+        presenter_task_.begin();
+        GifPlayer::set_presenter(&presenter_task_);
+    }
+    if (decode_slice_us_ > 0) {
+        // Decode gif frames in slices on a task of their own, so input is handled part way through long frames
+        decode_task_.begin();
+        GifPlayer::set_decoder(&decode_task_);
+    }
+    prefetch_task_.begin();
+    GifPlayer::set_prefetcher(&prefetch_task_);
+    AnimPlayer::set_prefetcher(&prefetch_task_);
+    boot_timeline_.end(BootPhase::PLAYER_SETUP);
+
+    boot_timeline_.begin(BootPhase::BOOT_GIF);
+    if (startFile("/gifs/boot.gif")) {
+        playFrame(nullptr);
         delay(50);
+        waitForWifiSettle();
         digitalWrite(PIN_LCD_BACKLIGHT, HIGH);
         delay(200);
-        while (GifPlayer::play_frame(nullptr)) {
+        while (playFrame(nullptr)) {
             yield();
         }
         digitalWrite(PIN_LCD_BACKLIGHT, LOW);
         delay(500);
-        GifPlayer::stop();
+        stopFile();
     }
-
-    std::vector<std::string> main_gifs;
-    std::vector<std::string> christmas_gifs;
-
-    int num_main_gifs = enumerateGifs( "/gifs/main", main_gifs);
-    int num_christmas_gifs = enumerateGifs( "/gifs/christmas", christmas_gifs);
-    int current_file = -1;
+    boot_timeline_.end(BootPhase::BOOT_GIF);
+
+    int library_counts[LIBRARY_SCAN_MAX_LIBRARIES];
+    library_scan_task_.wait(library_counts);
+    library_scanned_ = true;
+    boot_timeline_.record(BootPhase::LIBRARY_SCAN, library_scan_task_.startMillis(), library_scan_task_.endMillis());
+    int num_main_gifs = library_counts[0];
+    int num_christmas_gifs = library_counts[1];
+    last_index_save_millis_ = millis();
+    boot_timeline_.begin(BootPhase::FIRST_GIF);
+    bool booted = false;
+    uint8_t main_max_weight = loadWeights(main_gifs_, main_weights_);
+    uint8_t christmas_max_weight = loadWeights(christmas_gifs_, christmas_weights_);
+    main_order_.reset(num_main_gifs, main_order_policy_, esp_random(), shuffle_history_,
+            main_max_weight, playlistWeight, &main_weights_);
+    christmas_order_.reset(num_christmas_gifs, christmas_order_policy_, esp_random(), shuffle_history_,
+            christmas_max_weight, playlistWeight, &christmas_weights_);
     const char* current_file_name = "";
+    // The file on screen; differs from current_file_name while the last frame shows after choosing the next one
+    const char* playing_file_name = "";
     uint32_t minimum_loop_duration = 0;
     uint32_t start_millis = UINT32_MAX;
 
     bool last_christmas; // I gave you my heart...
 
+    // Picks the file to play into current_file_name; returns false if there is nothing to play
+    auto choose_gif = [&]() {
+        if (millis() - start_millis <= minimum_loop_duration) {
+            // Keep looping the current file until the minimum loop duration is met
+            return true;
+        }
+        if (isChristmas()) {
+            if (num_christmas_gifs == 0) {
+                return false;
+            }
+            current_file_name = christmas_gifs_.get(christmas_order_.next());
+            minimum_loop_duration = 30000;
+            Serial.printf("Chose christmas gif: %s\n", current_file_name);
+        } else {
+            if (num_main_gifs == 0) {
+                return false;
+            }
+            current_file_name = main_gifs_.get(main_order_.next());
+            minimum_loop_duration = 0;
+            Serial.printf("Chose gif: %s\n", current_file_name);
+        }
+        start_millis = millis();
+        return true;
+    };
+
+    // Set once a gif's last frame is on screen and the next file has been chosen (and prefetched)
+    bool next_chosen = false;
+    bool transition_pending = false;
+    uint32_t transition_deadline = 0;
+    bool backlight_on = false;
+
     main_task_.registerEventQueue(event_queue_);
 
     State state = State::CHOOSE_GIF;
     int frame_delay = 0;
-    uint32_t last_frame = 0;
+    // Kept across passes while a frame is decoded in slices
+    uint32_t frame_start = 0;
+    bool frame_present = true;
+    // How long the next pass may wait for input before going on; set when there is nothing else to do until then
+    uint32_t wait_ms = 0;
     while (1) {
         bool left_button = false;
         bool right_button = false;
+        uint32_t button_time_us = 0;
         Event event;
-        if (xQueueReceive(event_queue_, &event, 0)) {
+        // A press wakes this straight away instead of being noticed after a sleep
+        if (xQueueReceive(event_queue_, &event, pdMS_TO_TICKS(wait_ms))) {
             switch (event.type) {
                 case EventType::BUTTON:
                     if (event.button.event == ace_button::AceButton::kEventPressed) {
@@ -255,53 +357,64 @@ void DisplayTask::run() {
                         } else if (event.button.button_id == BUTTON_ID_RIGHT) {
                             right_button = true;
                         }
+                        button_time_us = event.time_us;
                     }
                     break;
             }
         }
+        wait_ms = 0;
         handleLogRendering();
+        if (perf_log_interval_ms_ > 0 && millis() - last_perf_log_millis_ > perf_log_interval_ms_) {
+            logPerf();
+            last_perf_log_millis_ = millis();
+        }
         switch (state) {
             case State::CHOOSE_GIF:
                 Serial.println("Choose gif");
-                if (millis() - start_millis > minimum_loop_duration) {
-                    // Only change the file if we've exceeded the minimum loop duration
-                    if (isChristmas()) {
-                        if (num_christmas_gifs > 0) {
-                            current_file_name = christmas_gifs[current_file++ % num_christmas_gifs].c_str();
-                            minimum_loop_duration = 30000;
-                            Serial.printf("Chose christmas gif: %s\n", current_file_name);
-                        } else {
-                            continue;
-                        }
-                    } else {
-                        if (num_main_gifs > 0) {
-                            int next_file = current_file;
-                            while (num_main_gifs > 1 && next_file == current_file) {
-                                next_file = random(num_main_gifs);
-                            }
-                            current_file = next_file;
-                            current_file_name = main_gifs[current_file].c_str();
-                            minimum_loop_duration = 0;
-                            Serial.printf("Chose gif: %s\n", current_file_name);
-                        } else {
-                            continue;
-                        }
-                    }
-                    start_millis = millis();
+                if (!next_chosen && !choose_gif()) {
+                    continue;
                 }
-                if (!GifPlayer::start(current_file_name)) {
+                next_chosen = false;
+                if (!startFile(current_file_name)) {
+                    transition_pending = false;
                     continue;
                 }
-                last_frame = millis();
-                GifPlayer::play_frame(&frame_delay);
-                delay(50);
-                digitalWrite(PIN_LCD_BACKLIGHT, HIGH);
+                playing_file_name = current_file_name;
+                {
+                    uint32_t frame_start_us = micros();
+                    playFrame(&frame_delay);
+                    if (input_pending_) {
+                        GifPlayer::FrameStats stats = playing_anim_ ? AnimPlayer::get_last_frame_stats() : GifPlayer::get_last_frame_stats();
+                        recordInputLatency(stats.window_commands > 0 ? frame_start_us + stats.first_push_us : micros());
+                    }
+                }
+                if (transition_pending) {
+                    recordTransitionGap(millis() - transition_deadline);
+                    transition_pending = false;
+                }
+                frame_scheduler_.start(millis(), frame_delay);
+                if (!backlight_on) {
+                    delay(50);
+                    waitForWifiSettle();
+                    digitalWrite(PIN_LCD_BACKLIGHT, HIGH);
+                    backlight_on = true;
+                }
+                if (!booted) {
+                    boot_timeline_.end(BootPhase::FIRST_GIF);
+                    boot_timeline_.print(Serial);
+                    char buf[48];
+                    snprintf(buf, sizeof(buf), "First gif at %u ms", boot_timeline_.totalMillis());
+                    log(buf);
+                    booted = true;
+                }
                 state = State::PLAY_GIF;
                 break;
             case State::PLAY_GIF: {
                 if (right_button) {
-                    GifPlayer::stop();
+                    stopFile();
                     int center = tft_.width()/2;
+                    input_time_us_ = button_time_us;
+                    recordInputLatency(micros());
                     tft_.fillScreen(TFT_BLACK);
                     tft_.setTextSize(2);
                     tft_.setTextDatum(TC_DATUM);
@@ -328,24 +441,66 @@ void DisplayTask::run() {
                 }
 
                 if (left_button || christmas_changed) {
+                    if (left_button) {
+                        // Timed to the first frame of the next gif
+                        input_pending_ = true;
+                        input_time_us_ = button_time_us;
+                    }
                     // Force select new gif, even if we hadn't met the minimum loop duration yet
                     minimum_loop_duration = 0;
-                    GifPlayer::stop();
+                    next_chosen = false;
+                    printGifStats(playing_file_name);
+                    stopFile();
                     state = State::CHOOSE_GIF;
                     break;
                 }
-                uint32_t time_since_last_frame = millis() - last_frame;
-                if (time_since_last_frame > frame_delay) {
-                    // Time for the next frame; play it
-                    last_frame = millis();
-                    if (!GifPlayer::play_frame(&frame_delay)) {
-                        GifPlayer::stop();
-                        state = State::CHOOSE_GIF;
+                // After the last frame there is nothing left to decode ahead of time, so wait out its full delay
+                int32_t time_until_next = next_chosen
+                    ? frame_scheduler_.timeUntilDeadline(millis())
+                    : frame_scheduler_.timeUntilNext(millis());
+                if (time_until_next <= 0 && next_chosen) {
+                    // The last frame has been on screen for its full delay; switch to the next file right away
+                    transition_deadline = frame_scheduler_.deadline();
+                    transition_pending = true;
+                    printGifStats(playing_file_name);
+                    recordDecodeCost(playing_file_name);
+                    stopFile();
+                    state = State::CHOOSE_GIF;
+                    break;
+                } else if (time_until_next <= 0 || GifPlayer::is_frame_in_progress()) {
+                    // Time for the next frame; play it, or the next slice of it
+                    if (!GifPlayer::is_frame_in_progress()) {
+                        frame_start = millis();
+                        bool can_drop = !playing_anim_ && GifPlayer::can_skip_draw();
+                        frame_present = !can_drop || frame_scheduler_.shouldPresent(frame_start);
+                    }
+                    bool more_frames;
+                    if (!playing_anim_ && decode_slice_us_ > 0) {
+                        GifPlayer::FrameProgress progress = GifPlayer::play_frame_step(&frame_delay, decode_slice_us_, 0, frame_present);
+                        if (progress == GifPlayer::FrameProgress::IN_PROGRESS) {
+                            // Back round the loop to take input and update the log bar before the next slice
+                            break;
+                        }
+                        more_frames = progress == GifPlayer::FrameProgress::MORE_FRAMES;
+                    } else {
+                        more_frames = playFrame(&frame_delay, frame_present);
+                    }
+                    frame_scheduler_.frameDone(frame_start, millis(), frame_delay, frame_present);
+                    if (!more_frames) {
+                        // Choose the next file now so it can be opened on the other core while the last frame shows
+                        if (choose_gif()) {
+                            next_chosen = true;
+                            prefetchFile(current_file_name);
+                        } else {
+                            printGifStats(playing_file_name);
+                            stopFile();
+                            state = State::CHOOSE_GIF;
+                        }
                         break;
                     }
                 } else {
-                    // Wait until it's time for the next frame, but up to 50ms max at a time to avoid stalling UI thread
-                    delay(min((uint32_t)50, frame_delay - time_since_last_frame));
+                    // Wait for input until it's time for the next frame
+                    wait_ms = min((int32_t)EVENT_WAIT_MAX_MS, time_until_next);
                 }
 
                 break;
@@ -355,59 +510,283 @@ void DisplayTask::run() {
                     // Exit credits
                     main_task_.setOtaEnabled(false);
                     state = State::CHOOSE_GIF;
+                    input_time_us_ = button_time_us;
+                    recordInputLatency(micros());
                     tft_.fillScreen(TFT_BLACK);
                     delay(200);
+                } else {
+                    wait_ms = EVENT_WAIT_MAX_MS;
                 }
                 break;
         }
     }
 }
 
+// Play the pre-transcoded .anim next to a gif when one exists, as it streams without LZW decoding
+// Files played before the library scan is done, like the boot gif, aren't looked up
+const GifIndex::Entry* DisplayTask::findIndexed(const char* gif_path) const {
+    return library_scanned_ ? gif_index_.find(gif_path) : nullptr;
+}
+
+bool DisplayTask::startFile(const char* gif_path) {
+    std::string anim_path(gif_path);
+    anim_path.replace(anim_path.size() - 4, 4, ".anim");
+    // The library scan noted which gifs have an .anim; only files it didn't index are looked for on the card
+    const GifIndex::Entry* entry = findIndexed(gif_path);
+    bool has_anim = entry != nullptr ? entry->has_anim : SD_MMC.exists(anim_path.c_str());
+    if (has_anim && AnimPlayer::start(anim_path.c_str())) {
+        playing_anim_ = true;
+        return true;
+    }
+    playing_anim_ = false;
+    return GifPlayer::start(gif_path, entry != nullptr ? entry->size : 0);
+}
+
+// Prefetch whichever of the gif and its .anim startFile() will play
+void DisplayTask::prefetchFile(const char* gif_path) {
+    const GifIndex::Entry* entry = findIndexed(gif_path);
+    if (entry != nullptr && entry->has_anim) {
+        std::string anim_path(gif_path);
+        anim_path.replace(anim_path.size() - 4, 4, ".anim");
+        AnimPlayer::prefetch(anim_path.c_str());
+        return;
+    }
+    GifPlayer::prefetch(gif_path, entry != nullptr ? entry->size : 0);
+}
+
+bool DisplayTask::playFrame(int* frame_delay, bool present) {
+    return playing_anim_ ? AnimPlayer::play_frame(frame_delay) : GifPlayer::play_frame(frame_delay, present);
+}
+
+void DisplayTask::stopFile() {
+    if (playing_anim_) {
+        AnimPlayer::stop();
+    } else {
+        GifPlayer::stop();
+    }
+}
+
+// Looks up the configured weight of every gif in playlist, returning the largest. Leaves weights empty when the
+// config gives none, as the shuffle then never asks.
+uint8_t DisplayTask::loadWeights(const Playlist& playlist, std::vector<uint8_t>& weights) {
+    weights.clear();
+    if (gif_weights_.empty()) {
+        return 1;
+    }
+    uint8_t max_weight = 1;
+    weights.assign(playlist.size(), 1);
+    for (size_t i = 0; i < playlist.size(); i++) {
+        auto it = gif_weights_.find(playlist.get(i));
+        if (it != gif_weights_.end()) {
+            weights[i] = it->second;
+            max_weight = max(max_weight, it->second);
+        }
+    }
+    return max_weight;
+}
+
+uint8_t DisplayTask::playlistWeight(uint32_t index, void* context) {
+    return (*static_cast<const std::vector<uint8_t>*>(context))[index];
+}
+
+PlaylistOrder DisplayTask::parseOrder(const std::string& name, PlaylistOrder default_order) {
+    if (name == "shuffle") {
+        return PlaylistOrder::SHUFFLE;
+    } else if (name == "sequential") {
+        return PlaylistOrder::SEQUENTIAL;
+    }
+    return default_order;
+}
+
 bool DisplayTask::isChristmas() {
     tm local;
     return main_task_.getLocalTime(&local) && local.tm_mon == 11 && local.tm_mday == 25;
 }
 
+void DisplayTask::printGifStats(const char* file_name) {
+    GifPlayer::FrameStats stats = playing_anim_ ? AnimPlayer::get_stats() : GifPlayer::get_stats();
+    if (stats.frames == 0) {
+        return;
+    }
+    Serial.printf("%s: %u frames, %u windows/frame, %u bytes/frame, %.1f fps max, %u us DMA wait/frame\n",
+        file_name,
+        stats.frames,
+        stats.window_commands / stats.frames,
+        stats.pushed_bytes / stats.frames,
+        stats.render_us > 0 ? stats.frames * 1000000.0 / stats.render_us : 0.0,
+        stats.dma_wait_us / stats.frames);
+    if (!playing_anim_) {
+        BlockReader::Stats io = GifPlayer::get_io_stats();
+        Serial.printf("  read cache: %u hits, %u misses, %u bytes from SD, %u seeks in %u us\n",
+            io.hits,
+            io.misses,
+            io.sd_bytes,
+            io.seeks,
+            io.seek_us);
+    }
+    FrameScheduler::Stats timing = frame_scheduler_.getStats();
+    if (timing.presented > 0) {
+        Serial.printf("  timing: %u presented, %u dropped, %u ms avg late, %u ms max late, histogram",
+            timing.presented,
+            timing.dropped,
+            timing.total_lateness_ms / timing.presented,
+            timing.max_lateness_ms);
+        for (int i = 0; i < FrameScheduler::kHistogramBuckets; i++) {
+            if (i < FrameScheduler::kHistogramBuckets - 1) {
+                Serial.printf(" <=%ums:%u", FrameScheduler::kBucketLimits[i], timing.histogram[i]);
+            } else {
+                Serial.printf(" more:%u", timing.histogram[i]);
+            }
+        }
+        Serial.printf("\n");
+    }
+
+    GifCache::Stats cache = GifPlayer::get_cache_stats();
+    uint32_t lookups = cache.hits + cache.misses;
+    if (lookups > 0) {
+        Serial.printf("  gif cache: %u%% hit rate, %u entries, %u bytes resident, %u evictions\n",
+            cache.hits * 100 / lookups,
+            cache.entries,
+            (unsigned)cache.resident_bytes,
+            cache.evictions);
+    }
+    FrameCache::Stats frames = GifPlayer::get_frame_cache_stats();
+    if (frames.entries > 0) {
+        Serial.printf("  frame cache: %u gifs, %u bytes (%.1fx compression), replaying at %.1f fps\n",
+            frames.entries,
+            (unsigned)frames.resident_bytes,
+            frames.resident_bytes > 0 ? (float)frames.raw_bytes / frames.resident_bytes : 0.0,
+            frames.replay_us > 0 ? frames.replayed_frames * 1000000.0 / frames.replay_us : 0.0);
+    }
+}
+
+// Remember how expensive the gif that just finished was to decode, writing the index out now and then
+void DisplayTask::recordDecodeCost(const char* file_name) {
+    if (playing_anim_) {
+        return;
+    }
+    GifPlayer::FrameStats stats = GifPlayer::get_stats();
+    if (stats.frames > 0) {
+        // Frames replayed from the frame cache have no decode or palette time and aren't recorded
+        gif_index_.recordDecodeCost(file_name, (stats.decode_us + stats.palette_us) / stats.frames);
+    }
+    if (millis() - last_index_save_millis_ > INDEX_SAVE_INTERVAL_MS) {
+        gif_index_.save(SD_MMC, GIF_INDEX_PATH);
+        last_index_save_millis_ = millis();
+    }
+}
+
+// Keeps the backlight off until wifi has been starting for WIFI_SETTLE_MS, so the two current peaks don't coincide
+void DisplayTask::waitForWifiSettle() {
+    if (!wifi_settling_) {
+        return;
+    }
+    uint32_t elapsed = millis() - wifi_settle_start_millis_;
+    if (elapsed < WIFI_SETTLE_MS) {
+        delay(WIFI_SETTLE_MS - elapsed);
+    }
+    boot_timeline_.end(BootPhase::WIFI_SETTLE);
+    wifi_settling_ = false;
+}
+
+void DisplayTask::recordTransitionGap(uint32_t gap_ms) {
+    transitions_++;
+    transition_gap_total_ms_ += gap_ms;
+    transition_gap_max_ms_ = max(transition_gap_max_ms_, gap_ms);
+    Serial.printf("Transition gap: %u ms (%u ms avg, %u ms max over %u transitions)\n",
+        gap_ms,
+        transition_gap_total_ms_ / transitions_,
+        transition_gap_max_ms_,
+        transitions_);
+}
+
+// response_us is micros() when the first pixels answering the press at input_time_us_ went to the panel
+void DisplayTask::recordInputLatency(uint32_t response_us) {
+    input_pending_ = false;
+    input_latency_us_.add(response_us - input_time_us_);
+    Serial.printf("Input latency: %u us (%u us min, %u us avg, %u us max over %u presses)\n",
+        response_us - input_time_us_,
+        input_latency_us_.min(),
+        input_latency_us_.avg(),
+        input_latency_us_.max(),
+        (unsigned)input_latency_us_.count());
+}
+
+// Dump the rolling gif pipeline counters to serial, with a short summary for the log bar
+void DisplayTask::logPerf() {
+    const PerfCounters& perf = GifPlayer::get_perf();
+    if (perf.samples() == 0) {
+        return;
+    }
+    Serial.printf("Perf over last %u frames:        min      avg      max      p99\n", (unsigned)perf.samples());
+    for (int i = 0; i < (int)PerfMetric::COUNT; i++) {
+        PerfMetric metric = (PerfMetric)i;
+        PerfCounters::Summary summary = perf.summary(metric);
+        Serial.printf("  %-28s %8u %8u %8u %8u\n", PerfCounters::name(metric), summary.min, summary.avg, summary.max, summary.p99);
+    }
+
+    PerfCounters::Summary decode = perf.summary(PerfMetric::DECODE_US);
+    PerfCounters::Summary push = perf.summary(PerfMetric::PUSH_US);
+    char buf[64];
+    snprintf(buf, sizeof(buf), "dec %.1f/%.1f spi %.1f/%.1f ms",
+        decode.avg / 1000.0,
+        decode.p99 / 1000.0,
+        push.avg / 1000.0,
+        push.p99 / 1000.0);
+    log(buf);
+    Serial.printf("Log ring: %u overwritten, %u dropped\n", log_ring_.overwrites(), log_ring_.drops());
+}
+
 void DisplayTask::handleLogRendering() {
     uint32_t now = millis();
-    // Check for new message
+    // Check for new message; only the newest is shown, anything older was already printed to serial
+    uint32_t token = shown_log_token_;
+    const LogRecord* record = log_ring_.newest(&token);
     bool force_redraw = false;
-    if (now - last_message_millis_ > 100) {
-        std::string* log_string;
-        if (xQueueReceive(log_queue_, &log_string, 0) == pdTRUE) {
-            last_message_millis_ = now;
-            force_redraw = true;
-            strncpy(current_message_, log_string->c_str(), sizeof(current_message_));
-            delete log_string;
-        }
+    if (record != nullptr && token != shown_log_token_ && now - last_message_millis_ > 100) {
+        last_message_millis_ = now;
+        force_redraw = true;
+        shown_log_token_ = token;
+        log_ring_.markRead(token);
     }
 
     bool show = show_log_ && (now - last_message_millis_ < 3000);
 
     if (show && (!message_visible_ || force_redraw)) {
-        GifPlayer::set_max_line(124);
-        tft_.fillRect(0, 124, DISPLAY_WIDTH, 11, TFT_BLACK);
-        tft_.setTextSize(1);
-        tft_.setTextDatum(TL_DATUM);
-        tft_.drawString(current_message_, 3, 126);
+        // Black (OVERLAY_KEY) pixels of the bar show the gif underneath, dimmed; it goes out with the next frame
+        log_bar_.fillSprite(OVERLAY_KEY);
+        if (record != nullptr) {
+            // The record is drawn in place; if a writer replaced it meanwhile, draw again with the newer one next time
+            log_bar_.setTextSize(1);
+            log_bar_.setTextDatum(TL_DATUM);
+            log_bar_.setTextColor(record->severity == LogSeverity::ERROR ? TFT_RED
+                : record->severity == LogSeverity::WARNING ? TFT_YELLOW : TFT_WHITE);
+            log_bar_.drawString(record->message, 3, 2);
+            if (!log_ring_.unchanged(token)) {
+                shown_log_token_ = 0;
+            }
+        }
+        Overlay::set(static_cast<uint16_t*>(log_bar_.getPointer()), LOG_BAR_Y, LOG_BAR_HEIGHT);
     } else if (!show && message_visible_) {
-        tft_.fillRect(0, 124, DISPLAY_WIDTH, 11, TFT_BLACK);
-        GifPlayer::set_max_line(-1);
+        Overlay::clear();
     }
     message_visible_ = show;
 }
 
 void DisplayTask::log(const char* msg) {
-    Serial.println(msg);
-    // Allocate a string for the duration it's in the queue; it is free'd by the queue consumer
-    std::string* msg_str = new std::string(msg);
+    log(LogSeverity::INFO, msg);
+}
 
-    // Put string in queue (or drop if full to avoid blocking)
-    if (xQueueSendToBack(log_queue_, &msg_str, 0) != pdTRUE) {
-        delete msg_str;
-    }
+void DisplayTask::log(LogSeverity severity, const char* msg) {
+    Serial.println(msg);
+    // Copied into a fixed slot without allocating or blocking; the display shows the newest when it gets to it
+    log_ring_.write(severity, pcTaskGetTaskName(NULL), msg, millis());
 }
 
 void DisplayTask::log(String msg) {
     log(msg.c_str());
 }
+
+void DisplayTask::log(LogSeverity severity, String msg) {
+    log(severity, msg.c_str());
+}
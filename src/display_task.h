@@ -4,10 +4,28 @@
 #include <SD_MMC.h>
 #include <TFT_eSPI.h>
 
+#include <map>
+#include <string>
+#include <vector>
+
+#include "boot_timeline.h"
+#include "decode_task.h"
 #include "logger.h"
+#include "frame_scheduler.h"
+#include "gif_index.h"
+#include "library_scan_task.h"
 #include "main_task.h"
+#include "perf_counters.h"
+#include "prefetch_task.h"
+#include "presenter_task.h"
+#include "shuffle_engine.h"
 #include "task.h"
 
+#define LOG_RING_CAPACITY 16
+#define LOG_BAR_Y 124
+#define LOG_BAR_HEIGHT 11
+#define INPUT_LATENCY_WINDOW 16
+
 enum class State {
     CHOOSE_GIF,
     PLAY_GIF,
@@ -22,6 +40,7 @@ class DisplayTask : public Task<DisplayTask>, public Logger {
         virtual ~DisplayTask() {};
 
         void log(const char* msg) override;
+        void log(LogSeverity severity, const char* msg) override;
 
     protected:
         void run();
@@ -29,20 +48,83 @@ class DisplayTask : public Task<DisplayTask>, public Logger {
     private:
         bool performUpdate(Stream &updateSource, size_t updateSize);
         bool updateFromFS(fs::FS &fs);
-        int enumerateGifs( const char* basePath, std::vector<std::string>& out_files);
         bool isChristmas();
+        PlaylistOrder parseOrder(const std::string& name, PlaylistOrder default_order);
+        uint8_t loadWeights(const Playlist& playlist, std::vector<uint8_t>& weights);
+        static uint8_t playlistWeight(uint32_t index, void* context);
+
+        const GifIndex::Entry* findIndexed(const char* gif_path) const;
+        bool startFile(const char* gif_path);
+        void prefetchFile(const char* gif_path);
+        bool playFrame(int* frame_delay, bool present = true);
+        void stopFile();
         void handleLogRendering();
+        void printGifStats(const char* file_name);
+        void logPerf();
+        void recordTransitionGap(uint32_t gap_ms);
+        void recordInputLatency(uint32_t response_us);
+        void recordDecodeCost(const char* file_name);
+        void waitForWifiSettle();
 
         void log(String msg);
+        void log(LogSeverity severity, String msg);
 
         TFT_eSPI tft_ = TFT_eSPI();
+        // Rendered once per message and blended over the bottom lines by the players
+        TFT_eSprite log_bar_ = TFT_eSprite(&tft_);
         MainTask& main_task_;
-        QueueHandle_t log_queue_;
+        PresenterTask presenter_task_;
+        DecodeTask decode_task_;
+        PrefetchTask prefetch_task_;
+        FrameScheduler frame_scheduler_;
+        GifIndex gif_index_;
+        LibraryScanTask library_scan_task_;
+        // The index belongs to the library scan until this is set
+        bool library_scanned_ = false;
+        BootTimeline boot_timeline_;
+        bool wifi_settling_ = false;
+        uint32_t wifi_settle_start_millis_ = 0;
+        Playlist main_gifs_;
+        Playlist christmas_gifs_;
+        ShuffleEngine main_order_;
+        ShuffleEngine christmas_order_;
+        PlaylistOrder main_order_policy_ = PlaylistOrder::SHUFFLE;
+        PlaylistOrder christmas_order_policy_ = PlaylistOrder::SEQUENTIAL;
+        uint8_t shuffle_history_ = 8;
+        // Shuffle weights from the config by gif path, and per playlist index once the library is scanned. Files
+        // not listed have weight 1.
+        std::map<std::string, uint8_t> gif_weights_;
+        std::vector<uint8_t> main_weights_;
+        std::vector<uint8_t> christmas_weights_;
+        uint32_t last_index_save_millis_ = 0;
+        LogRing<LOG_RING_CAPACITY> log_ring_;
         QueueHandle_t event_queue_;
 
         bool show_log_ = false;
+        bool frame_buffer_ = false;
+        bool composite_ = false;
+        bool upscale_ = false;
+        bool dma_ = false;
+        bool split_decode_ = false;
+        uint32_t decode_slice_us_ = 0;
+        int read_block_size_ = 0;
+        int gif_cache_kb_ = 0;
+        int gif_cache_max_file_kb_ = 0;
+        int frame_cache_kb_ = 0;
+        uint32_t perf_log_interval_ms_ = 0;
+        uint32_t last_perf_log_millis_ = 0;
+        bool playing_anim_ = false;
+
+        // Time between the end of a gif's last frame delay and the first frame of the next one
+        uint32_t transitions_ = 0;
+        uint32_t transition_gap_total_ms_ = 0;
+        uint32_t transition_gap_max_ms_ = 0;
+        // Capture time of a button press whose response hasn't been drawn yet
+        bool input_pending_ = false;
+        uint32_t input_time_us_ = 0;
+        RollingStat<INPUT_LATENCY_WINDOW> input_latency_us_;
         bool message_visible_ = false;
-        char current_message_[200];
+        uint32_t shown_log_token_ = 0;
         uint32_t last_message_millis_ = UINT32_MAX;
 
 };
@@ -4,6 +4,7 @@
 
 #define BUTTON_ID_LEFT 0
 #define BUTTON_ID_RIGHT 1
+#define BUTTON_COUNT 2
 
 enum class EventType {
     BUTTON,
@@ -16,6 +17,7 @@ struct EventButton {
 
 struct Event {
     EventType type;
+    uint32_t time_us;  // micros() when it happened, e.g. the first edge of a button press
     union {
         EventButton button;
     };
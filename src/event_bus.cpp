@@ -0,0 +1,20 @@
+#include "event_bus.h"
+
+bool EventBus::subscribe(QueueHandle_t queue) {
+    for (std::atomic<QueueHandle_t>& slot : subscribers_) {
+        QueueHandle_t empty = nullptr;
+        if (slot.compare_exchange_strong(empty, queue, std::memory_order_release, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void EventBus::publish(const Event& event) {
+    for (std::atomic<QueueHandle_t>& slot : subscribers_) {
+        QueueHandle_t queue = slot.load(std::memory_order_acquire);
+        if (queue != nullptr && xQueueSend(queue, &event, 0) != pdTRUE) {
+            drops_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+#include "event.h"
+
+#define EVENT_BUS_MAX_SUBSCRIBERS 4
+
+// Fans events out to the queues of every subscriber without taking a lock. Subscribers claim a fixed slot, so the
+// publisher only walks the slots and offers each queue a copy with no wait: an event is dropped for a subscriber
+// whose queue is full rather than holding up the publisher or the other subscribers.
+class EventBus {
+    public:
+        // Any task; returns false if every slot is taken
+        bool subscribe(QueueHandle_t queue);
+
+        // Any task; never blocks
+        void publish(const Event& event);
+
+        // Events not delivered because a subscriber's queue was full
+        uint32_t drops() const { return drops_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<QueueHandle_t> subscribers_[EVENT_BUS_MAX_SUBSCRIBERS] = {};
+        std::atomic<uint32_t> drops_ {0};
+};
@@ -0,0 +1,166 @@
+#include "frame_cache.h"
+
+// Repeats shorter than this are cheaper to store as literals
+#define MIN_RUN 3
+
+void FrameCache::configure(size_t budget_bytes) {
+    budget_bytes_ = budget_bytes;
+    while (resident_bytes_ > budget_bytes_ && !entries_.empty()) {
+        evictLru();
+    }
+}
+
+const FrameCache::Entry* FrameCache::find(const std::string& path) {
+    auto it = index_.find(path);
+    if (it == index_.end()) {
+        return nullptr;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return &*it->second;
+}
+
+bool FrameCache::beginCapture(const std::string& path) {
+    if (!enabled()) {
+        return false;
+    }
+    uint32_t hash = hashPath(path);
+    for (uint32_t too_large : too_large_) {
+        if (too_large == hash) {
+            return false;
+        }
+    }
+    capture_ = {path, {}, 0, 0};
+    frame_ = {0, {}};
+    capturing_ = true;
+    return true;
+}
+
+void FrameCache::captureWindow(int x, int y, int w, int h) {
+    if (!capturing_) {
+        return;
+    }
+    frame_.ops.insert(frame_.ops.end(), {FRAME_CACHE_WINDOW, (uint16_t)x, (uint16_t)y, (uint16_t)w, (uint16_t)h});
+}
+
+void FrameCache::capturePixels(const uint16_t* pixels, size_t count) {
+    if (!capturing_) {
+        return;
+    }
+    capture_.raw_bytes += count * sizeof(uint16_t);
+
+    std::vector<uint16_t>& ops = frame_.ops;
+    size_t literal_header = SIZE_MAX;
+    size_t i = 0;
+    while (i < count) {
+        size_t run = 1;
+        while (i + run < count && run < FRAME_CACHE_MAX_COUNT && pixels[i + run] == pixels[i]) {
+            run++;
+        }
+        if (run >= MIN_RUN) {
+            ops.push_back(FRAME_CACHE_RUN | run);
+            ops.push_back(pixels[i]);
+            literal_header = SIZE_MAX;
+            i += run;
+            continue;
+        }
+        if (literal_header == SIZE_MAX || ops[literal_header] == FRAME_CACHE_MAX_COUNT) {
+            literal_header = ops.size();
+            ops.push_back(0);
+        }
+        ops[literal_header]++;
+        ops.push_back(pixels[i]);
+        i++;
+    }
+
+    // Give up early rather than growing a frame that could never fit
+    if (capture_.bytes + ops.size() * sizeof(uint16_t) > budget_bytes_) {
+        abortCapture(true);
+    }
+}
+
+void FrameCache::endFrame(uint16_t delay_ms) {
+    if (!capturing_) {
+        return;
+    }
+    size_t bytes = frame_.ops.size() * sizeof(uint16_t) + sizeof(Frame);
+    if (!reserve(capture_.bytes + bytes)) {
+        abortCapture(true);
+        return;
+    }
+    frame_.delay_ms = delay_ms;
+    frame_.ops.shrink_to_fit();
+    capture_.bytes += bytes;
+    capture_.frames.push_back(std::move(frame_));
+    frame_ = {0, {}};
+}
+
+void FrameCache::finishCapture() {
+    if (!capturing_) {
+        return;
+    }
+    capturing_ = false;
+    capture_.frames.shrink_to_fit();
+    resident_bytes_ += capture_.bytes;
+    entries_.push_front(std::move(capture_));
+    index_[entries_.front().path] = entries_.begin();
+    capture_ = {};
+}
+
+void FrameCache::abortCapture(bool too_large) {
+    if (!capturing_) {
+        return;
+    }
+    if (too_large) {
+        too_large_[too_large_next_] = hashPath(capture_.path);
+        too_large_next_ = (too_large_next_ + 1) % FRAME_CACHE_TOO_LARGE_SLOTS;
+    }
+    capturing_ = false;
+    capture_ = {};
+    frame_ = {0, {}};
+}
+
+// Evicts older gifs until bytes more fit within the budget
+bool FrameCache::reserve(size_t bytes) {
+    if (bytes > budget_bytes_) {
+        return false;
+    }
+    while (resident_bytes_ + bytes > budget_bytes_ && !entries_.empty()) {
+        evictLru();
+    }
+    return true;
+}
+
+void FrameCache::evictLru() {
+    Entry& lru = entries_.back();
+    resident_bytes_ -= lru.bytes;
+    index_.erase(lru.path);
+    entries_.pop_back();
+}
+
+void FrameCache::recordReplay(uint32_t frames, uint32_t us) {
+    replayed_frames_ += frames;
+    replay_us_ += us;
+}
+
+FrameCache::Stats FrameCache::getStats() const {
+    size_t raw_bytes = 0;
+    for (const Entry& entry : entries_) {
+        raw_bytes += entry.raw_bytes;
+    }
+    return {
+        .entries = (uint32_t)entries_.size(),
+        .resident_bytes = resident_bytes_,
+        .raw_bytes = raw_bytes,
+        .replayed_frames = replayed_frames_,
+        .replay_us = replay_us_,
+    };
+}
+
+// FNV-1a, never 0 so that empty slots match no path
+uint32_t FrameCache::hashPath(const std::string& path) {
+    uint32_t hash = 2166136261u;
+    for (char c : path) {
+        hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+    return hash != 0 ? hash : 1;
+}
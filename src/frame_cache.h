@@ -0,0 +1,91 @@
+#pragma once
+
+#include <list>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Tokens in a cached frame's op stream
+#define FRAME_CACHE_WINDOW 0xFFFF   // followed by x, y, w, h: open an address window
+#define FRAME_CACHE_RUN 0x8000      // | count, followed by one pixel repeated count times
+#define FRAME_CACHE_MAX_COUNT 0x7FFE // otherwise count, followed by count literal pixels
+
+#define FRAME_CACHE_TOO_LARGE_SLOTS 32  // Gifs remembered as too large to capture; the oldest is forgotten first
+
+// Records what a gif pushes to the panel on its first play, as run-length-compressed RGB565, so later loops can
+// be replayed without decoding or reading the card. Whole gifs are evicted least recently played first when the
+// byte budget is exceeded. Only uses the standard library so it can be exercised on a host.
+class FrameCache {
+    public:
+        struct Frame {
+            uint16_t delay_ms;
+            std::vector<uint16_t> ops;
+        };
+
+        struct Entry {
+            std::string path;
+            std::vector<Frame> frames;
+            size_t bytes;
+            size_t raw_bytes;   // pixel bytes before compression
+        };
+
+        struct Stats {
+            uint32_t entries;
+            size_t resident_bytes;
+            size_t raw_bytes;
+            uint32_t replayed_frames;
+            uint32_t replay_us;
+        };
+
+        FrameCache() {};
+        FrameCache(FrameCache const&)=delete;
+        FrameCache& operator=(FrameCache const&)=delete;
+
+        // budget_bytes of 0 disables the cache
+        void configure(size_t budget_bytes);
+        bool enabled() const { return budget_bytes_ > 0; }
+
+        // Returns a fully captured gif and marks it most recently used, or nullptr
+        const Entry* find(const std::string& path);
+        // Like find(), without touching the LRU order
+        bool contains(const std::string& path) const { return index_.count(path) > 0; }
+
+        // Starts recording a gif; returns false if disabled or the gif previously didn't fit
+        bool beginCapture(const std::string& path);
+        bool capturing() const { return capturing_; }
+        void captureWindow(int x, int y, int w, int h);
+        void capturePixels(const uint16_t* pixels, size_t count);
+        void endFrame(uint16_t delay_ms);
+        void finishCapture();
+        // Drops the partial recording; if too_large the gif isn't captured again while it is among the last
+        // FRAME_CACHE_TOO_LARGE_SLOTS gifs that didn't fit
+        void abortCapture(bool too_large);
+
+        void recordReplay(uint32_t frames, uint32_t us);
+        Stats getStats() const;
+
+    private:
+        bool reserve(size_t bytes);
+        void evictLru();
+        static uint32_t hashPath(const std::string& path);
+
+        size_t budget_bytes_ = 0;
+        size_t resident_bytes_ = 0;
+
+        // Front is most recently used
+        std::list<Entry> entries_;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+        // Ring of path hashes rather than paths, so it stays a fixed size however many gifs don't fit. A collision
+        // only costs a gif its caching.
+        uint32_t too_large_[FRAME_CACHE_TOO_LARGE_SLOTS] = {};
+        uint8_t too_large_next_ = 0;
+
+        bool capturing_ = false;
+        Entry capture_;
+        Frame frame_;
+
+        uint32_t replayed_frames_ = 0;
+        uint32_t replay_us_ = 0;
+};
@@ -0,0 +1,62 @@
+#include "frame_scheduler.h"
+
+// Never drop more than this many frames in a row, so a gif that can't keep up still animates
+#define MAX_CONSECUTIVE_DROPS 4
+
+const uint16_t FrameScheduler::kBucketLimits[kHistogramBuckets - 1] = {1, 2, 5, 10, 20, 50, 100};
+
+void FrameScheduler::start(uint32_t now_ms, int frame_delay_ms) {
+    deadline_ms_ = now_ms + frame_delay_ms;
+    last_delay_ms_ = frame_delay_ms;
+    decode_estimate_ms_ = 0;
+    consecutive_drops_ = 0;
+    stats_ = {};
+}
+
+int32_t FrameScheduler::timeUntilNext(uint32_t now_ms) const {
+    // Start early by the expected decode time so the frame lands on its deadline
+    return (int32_t)(deadline_ms_ - decode_estimate_ms_ - now_ms);
+}
+
+bool FrameScheduler::shouldPresent(uint32_t now_ms) {
+    if (policy_ != FramePolicy::DROP) {
+        return true;
+    }
+    // Drop if even an immediate decode would land after the following frame is due
+    bool too_late = (int32_t)(now_ms + decode_estimate_ms_ - deadline_ms_) > last_delay_ms_;
+    if (too_late && consecutive_drops_ < MAX_CONSECUTIVE_DROPS) {
+        consecutive_drops_++;
+        return false;
+    }
+    consecutive_drops_ = 0;
+    return true;
+}
+
+void FrameScheduler::frameDone(uint32_t start_ms, uint32_t now_ms, int frame_delay_ms, bool presented) {
+    int32_t lateness = (int32_t)(now_ms - deadline_ms_);
+    if (presented) {
+        uint32_t late = lateness > 0 ? lateness : 0;
+        int bucket = 0;
+        while (bucket < kHistogramBuckets - 1 && late > kBucketLimits[bucket]) {
+            bucket++;
+        }
+        stats_.histogram[bucket]++;
+        stats_.presented++;
+        stats_.total_lateness_ms += late;
+        if (late > stats_.max_lateness_ms) {
+            stats_.max_lateness_ms = late;
+        }
+    } else {
+        stats_.dropped++;
+    }
+
+    // Smoothed decode time, used to start the next decode ahead of its deadline
+    decode_estimate_ms_ = (decode_estimate_ms_ * 3 + (now_ms - start_ms)) / 4;
+
+    if (policy_ == FramePolicy::RESYNC && lateness > last_delay_ms_) {
+        deadline_ms_ = now_ms + frame_delay_ms;
+    } else {
+        deadline_ms_ += frame_delay_ms;
+    }
+    last_delay_ms_ = frame_delay_ms;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+enum class FramePolicy {
+    CATCH_UP,   // Keep the absolute timeline; late frames are shown back to back until caught up
+    DROP,       // Keep the absolute timeline; frames too late to be seen are decoded without being presented
+    RESYNC,     // Restart the timeline from a frame that was more than a frame late
+};
+
+// Paces frames against absolute presentation deadlines rather than the time since the last frame, so decode time
+// doesn't stretch the authored timing, and records how late each presented frame was. Time is passed in by the
+// caller, so this is plain logic with no platform dependencies.
+class FrameScheduler {
+    public:
+        static const int kHistogramBuckets = 8;
+        // Upper bound (inclusive, ms) of each lateness bucket; the last bucket holds everything later
+        static const uint16_t kBucketLimits[kHistogramBuckets - 1];
+
+        struct Stats {
+            uint32_t presented;
+            uint32_t dropped;
+            uint32_t total_lateness_ms;
+            uint32_t max_lateness_ms;
+            uint32_t histogram[kHistogramBuckets];
+        };
+
+        void setPolicy(FramePolicy policy) { policy_ = policy; }
+
+        // The first frame was presented at now_ms and stays up for frame_delay_ms. Resets stats.
+        void start(uint32_t now_ms, int frame_delay_ms);
+
+        // Milliseconds until decoding of the next frame should begin; <= 0 when it is due
+        int32_t timeUntilNext(uint32_t now_ms) const;
+        // Milliseconds until the current frame has been up for its full delay, without starting early to decode the
+        // next one; <= 0 once it has
+        int32_t timeUntilDeadline(uint32_t now_ms) const { return (int32_t)(deadline_ms_ - now_ms); }
+
+        // Whether the frame that is due should be presented, or only decoded to catch up
+        bool shouldPresent(uint32_t now_ms);
+
+        // A frame that started decoding at start_ms finished at now_ms; schedule the next one
+        void frameDone(uint32_t start_ms, uint32_t now_ms, int frame_delay_ms, bool presented);
+
+        uint32_t deadline() const { return deadline_ms_; }
+        Stats getStats() const { return stats_; }
+
+    private:
+        FramePolicy policy_ = FramePolicy::CATCH_UP;
+        uint32_t deadline_ms_ = 0;
+        int last_delay_ms_ = 0;
+        uint32_t decode_estimate_ms_ = 0;
+        uint8_t consecutive_drops_ = 0;
+        Stats stats_ = {};
+};
@@ -0,0 +1,90 @@
+#include "gif_cache.h"
+
+#include <stdlib.h>
+
+GifCache::~GifCache() {
+    clear();
+}
+
+void GifCache::configure(size_t budget_bytes, size_t max_entry_bytes) {
+    budget_bytes_ = budget_bytes;
+    max_entry_bytes_ = max_entry_bytes;
+    evictTo(budget_bytes_);
+}
+
+const uint8_t* GifCache::find(const std::string& path, size_t* size) {
+    if (budget_bytes_ == 0) {
+        return nullptr;
+    }
+    auto it = index_.find(path);
+    if (it == index_.end()) {
+        misses_++;
+        return nullptr;
+    }
+    hits_++;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    *size = it->second->size;
+    return it->second->data;
+}
+
+bool GifCache::admits(size_t size) const {
+    return size > 0 && size <= max_entry_bytes_ && size <= budget_bytes_;
+}
+
+uint8_t* GifCache::insert(const std::string& path, size_t size) {
+    if (!admits(size)) {
+        return nullptr;
+    }
+    erase(path);
+    evictTo(budget_bytes_ - size);
+
+    uint8_t* data = static_cast<uint8_t*>(malloc(size));
+    if (data == nullptr) {
+        return nullptr;
+    }
+    entries_.push_front({path, data, size});
+    index_[path] = entries_.begin();
+    resident_bytes_ += size;
+    return data;
+}
+
+void GifCache::erase(const std::string& path) {
+    auto it = index_.find(path);
+    if (it == index_.end()) {
+        return;
+    }
+    resident_bytes_ -= it->second->size;
+    free(it->second->data);
+    entries_.erase(it->second);
+    index_.erase(it);
+}
+
+void GifCache::clear() {
+    for (Entry& entry : entries_) {
+        free(entry.data);
+    }
+    entries_.clear();
+    index_.clear();
+    resident_bytes_ = 0;
+}
+
+void GifCache::evictTo(size_t budget_bytes) {
+    while (resident_bytes_ > budget_bytes && !entries_.empty()) {
+        Entry& lru = entries_.back();
+        resident_bytes_ -= lru.size;
+        free(lru.data);
+        index_.erase(lru.path);
+        entries_.pop_back();
+        evictions_++;
+    }
+}
+
+GifCache::Stats GifCache::getStats() const {
+    return {
+        .hits = hits_,
+        .misses = misses_,
+        .evictions = evictions_,
+        .entries = (uint32_t)entries_.size(),
+        .resident_bytes = resident_bytes_,
+    };
+}
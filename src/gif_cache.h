@@ -0,0 +1,66 @@
+#pragma once
+
+#include <list>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+// Byte-budgeted cache of whole gif files keyed by path, evicting the least recently played entries. Only uses the
+// standard library so budgets can be tuned with the same code on a host.
+class GifCache {
+    public:
+        struct Stats {
+            uint32_t hits;
+            uint32_t misses;
+            uint32_t evictions;
+            uint32_t entries;
+            size_t resident_bytes;
+        };
+
+        GifCache() {};
+        ~GifCache();
+        GifCache(GifCache const&)=delete;
+        GifCache& operator=(GifCache const&)=delete;
+
+        // budget_bytes of 0 disables the cache. Files larger than max_entry_bytes are never cached.
+        void configure(size_t budget_bytes, size_t max_entry_bytes);
+        bool enabled() const { return budget_bytes_ > 0; }
+
+        // Returns the cached contents and marks the entry most recently used, or nullptr on a miss
+        const uint8_t* find(const std::string& path, size_t* size);
+
+        // Like find(), without counting a hit or miss or touching the LRU order
+        bool contains(const std::string& path) const { return index_.count(path) > 0; }
+
+        bool admits(size_t size) const;
+
+        // Evicts as needed and returns an uninitialized buffer of size bytes for the caller to fill, or nullptr if
+        // the file can't be cached. Erase the entry if filling it fails.
+        uint8_t* insert(const std::string& path, size_t size);
+        void erase(const std::string& path);
+        void clear();
+
+        Stats getStats() const;
+
+    private:
+        struct Entry {
+            std::string path;
+            uint8_t* data;
+            size_t size;
+        };
+
+        void evictTo(size_t budget_bytes);
+
+        size_t budget_bytes_ = 0;
+        size_t max_entry_bytes_ = 0;
+        size_t resident_bytes_ = 0;
+
+        // Front is most recently used
+        std::list<Entry> entries_;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+
+        uint32_t hits_ = 0;
+        uint32_t misses_ = 0;
+        uint32_t evictions_ = 0;
+};
@@ -0,0 +1,449 @@
+#include "gif_index.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+
+#define GIF_INDEX_MAGIC "GIX1"
+
+// On-card layout: magic, uint32 entry count, then per entry this record followed by path_length path bytes
+struct __attribute__((packed)) GifIndexRecord {
+    uint16_t path_length;
+    uint32_t size;
+    uint32_t mtime;
+    uint16_t width;
+    uint16_t height;
+    uint16_t frame_count;
+    uint32_t duration_ms;
+    uint32_t decode_us;
+};
+
+bool GifIndex::isGifPath(const char* path) {
+    size_t len = strlen(path);
+    return len > 4 && strcasecmp(path + len - 4, ".gif") == 0;
+}
+
+bool GifIndex::isAnimPath(const char* path) {
+    size_t len = strlen(path);
+    return len > 5 && strcasecmp(path + len - 5, ".anim") == 0;
+}
+
+// The gif an .anim was transcoded from, or an empty string if the path doesn't fit
+static void gifPathForAnim(const char* anim_path, char* gif_path, size_t size) {
+    size_t stem = strlen(anim_path) - 5;
+    if (stem + 5 > size) {
+        gif_path[0] = '\0';
+        return;
+    }
+    memcpy(gif_path, anim_path, stem);
+    strcpy(&gif_path[stem], ".gif");
+}
+
+bool GifIndex::load(fs::FS& fs, const char* index_path) {
+    paths_.clear();
+    entries_.clear();
+    dirty_ = false;
+
+    File file = fs.open(index_path);
+    if (!file) {
+        rebuildLookup();
+        return false;
+    }
+    size_t size = file.size();
+    std::vector<uint8_t> data(size);
+    size_t n = file.read(data.data(), size);
+    file.close();
+
+    const uint8_t* p = data.data();
+    const uint8_t* end = p + n;
+    uint32_t count;
+    if (n < 4 + sizeof(count) || memcmp(p, GIF_INDEX_MAGIC, 4) != 0) {
+        log_n("Ignoring invalid gif index");
+        rebuildLookup();
+        return false;
+    }
+    memcpy(&count, p + 4, sizeof(count));
+    p += 4 + sizeof(count);
+
+    // Size both arrays exactly before filling them, so each is a single allocation
+    size_t path_bytes = 0;
+    for (const uint8_t* q = p; end - q >= (ptrdiff_t)sizeof(GifIndexRecord); ) {
+        GifIndexRecord record;
+        memcpy(&record, q, sizeof(record));
+        q += sizeof(record) + record.path_length;
+        path_bytes += record.path_length + 1;
+    }
+    entries_.reserve(count);
+    paths_.reserve(path_bytes);
+    for (uint32_t i = 0; i < count; i++) {
+        GifIndexRecord record;
+        if (end - p < (ptrdiff_t)sizeof(record)) {
+            break;
+        }
+        memcpy(&record, p, sizeof(record));
+        p += sizeof(record);
+        if (end - p < record.path_length) {
+            break;
+        }
+        addEntry(reinterpret_cast<const char*>(p), record.path_length);
+        Entry& entry = entries_.back();
+        entry.size = record.size;
+        entry.mtime = record.mtime;
+        entry.width = record.width;
+        entry.height = record.height;
+        entry.frame_count = record.frame_count;
+        entry.duration_ms = record.duration_ms;
+        entry.decode_us = record.decode_us;
+        p += record.path_length;
+    }
+    if (entries_.size() != count) {
+        // Keep what was readable; the refresh fills in the rest and the next save repairs the file
+        log_n("Gif index truncated after %u of %u entries", (unsigned)entries_.size(), count);
+        dirty_ = true;
+    }
+    rebuildLookup();
+    return true;
+}
+
+bool GifIndex::save(fs::FS& fs, const char* index_path) {
+    if (!dirty_) {
+        return true;
+    }
+    // Serialize up front so the file is written with a single sequential write
+    std::vector<uint8_t> data;
+    uint32_t count = entries_.size();
+    data.insert(data.end(), GIF_INDEX_MAGIC, GIF_INDEX_MAGIC + 4);
+    data.insert(data.end(), reinterpret_cast<const uint8_t*>(&count), reinterpret_cast<const uint8_t*>(&count + 1));
+    for (const Entry& entry : entries_) {
+        GifIndexRecord record = {
+            entry.path_length,
+            entry.size,
+            entry.mtime,
+            entry.width,
+            entry.height,
+            entry.frame_count,
+            entry.duration_ms,
+            entry.decode_us,
+        };
+        const char* entry_path = path(entry);
+        data.insert(data.end(), reinterpret_cast<const uint8_t*>(&record), reinterpret_cast<const uint8_t*>(&record + 1));
+        data.insert(data.end(), entry_path, entry_path + entry.path_length);
+    }
+
+    File file = fs.open(index_path, FILE_WRITE);
+    if (!file) {
+        log_n("Failed to open %s for writing", index_path);
+        return false;
+    }
+    size_t written = file.write(data.data(), data.size());
+    file.close();
+    if (written != data.size()) {
+        log_n("Failed to write gif index");
+        return false;
+    }
+    dirty_ = false;
+    return true;
+}
+
+// Calls visit(vfs_path, path) for every gif and .anim under dir and up to GIF_INDEX_MAX_DEPTH levels of subfolders,
+// where path is vfs_path without the mount point. readdir and stat only touch directory entries, unlike opening each file
+// through the FS API. Subfolders are walked depth first with one open listing per level and a single path buffer, so
+// memory use is bounded.
+template <typename Visit>
+static bool walkGifs(const char* mount_point, const char* dir, Visit visit) {
+    DIR* listings[GIF_INDEX_MAX_DEPTH + 1];
+    size_t lengths[GIF_INDEX_MAX_DEPTH + 1];
+    char vfs_path[GIF_INDEX_MAX_PATH];
+    size_t mount_length = strlen(mount_point);
+    int written = snprintf(vfs_path, sizeof(vfs_path), "%s%s", mount_point, dir);
+    if (written < 0 || written >= (int)sizeof(vfs_path)) {
+        return false;
+    }
+    listings[0] = opendir(vfs_path);
+    if (listings[0] == nullptr) {
+        return false;
+    }
+    lengths[0] = written;
+
+    int depth = 0;
+    while (depth >= 0) {
+        struct dirent* dirent = readdir(listings[depth]);
+        if (dirent == nullptr) {
+            closedir(listings[depth]);
+            depth--;
+            continue;
+        }
+        if (dirent->d_name[0] == '.') {
+            continue;
+        }
+        // Append the name to the path of the current folder
+        size_t length = lengths[depth];
+        written = snprintf(&vfs_path[length], sizeof(vfs_path) - length, "/%s", dirent->d_name);
+        if (written < 0 || length + written >= sizeof(vfs_path)) {
+            log_n("Skipping %s, path too long", dirent->d_name);
+            continue;
+        }
+
+        if (dirent->d_type == DT_DIR) {
+            if (depth == GIF_INDEX_MAX_DEPTH) {
+                continue;
+            }
+            DIR* listing = opendir(vfs_path);
+            if (listing != nullptr) {
+                depth++;
+                listings[depth] = listing;
+                lengths[depth] = length + written;
+            }
+            continue;
+        }
+        if (GifIndex::isGifPath(dirent->d_name) || GifIndex::isAnimPath(dirent->d_name)) {
+            visit(vfs_path, &vfs_path[mount_length]);
+        }
+    }
+    return true;
+}
+
+int GifIndex::refresh(const char* mount_point, const char* dir) {
+    char prefix[GIF_INDEX_MAX_PATH];
+    size_t prefix_length = snprintf(prefix, sizeof(prefix), "%s/", dir);
+    for (Entry& entry : entries_) {
+        entry.seen = false;
+        if (under(entry, prefix, prefix_length)) {
+            entry.has_anim = false;
+        }
+    }
+    probed_ = 0;
+    probe_state_ = ProbeState::IDLE;
+
+    // Known gifs are checked (and reprobed if they changed) in a first pass, which only counts new ones. The
+    // entries and path pool then grow once to fit those, and a second pass probes and adds them. .anim files are
+    // matched to their gifs as they are listed; those whose gif is new are matched once it is in the lookup.
+    size_t new_entries = 0;
+    size_t new_path_bytes = 0;
+    size_t unmatched_anims = 0;
+    bool listed = walkGifs(mount_point, dir, [&](const char* vfs_path, const char* path) {
+        if (isAnimPath(path)) {
+            if (!markAnim(path)) {
+                unmatched_anims++;
+            }
+        } else if (!scanKnownFile(vfs_path, path)) {
+            new_entries++;
+            new_path_bytes += strlen(path) + 1;
+        }
+    });
+    if (!listed) {
+        log_n("Failed to list %s", dir);
+        return -1;
+    }
+    if (new_entries > 0) {
+        entries_.reserve(entries_.size() + new_entries);
+        paths_.reserve(paths_.size() + new_path_bytes);
+        walkGifs(mount_point, dir, [&](const char* vfs_path, const char* path) {
+            if (!isAnimPath(path) && find(path) == nullptr) {
+                scanNewFile(vfs_path, path);
+            }
+        });
+    }
+    if (probe_state_ == ProbeState::PROBING) {
+        GifPlayer::end_probing();
+    }
+
+    removeUnseen(prefix);
+    rebuildLookup();
+    if (unmatched_anims > 0 && new_entries > 0) {
+        walkGifs(mount_point, dir, [&](const char* vfs_path, const char* path) {
+            if (isAnimPath(path)) {
+                markAnim(path);
+            }
+        });
+    }
+    return probed_;
+}
+
+// Notes the .anim at anim_path on its gif. Returns false if the gif isn't in the lookup.
+bool GifIndex::markAnim(const char* anim_path) {
+    char gif_path[GIF_INDEX_MAX_PATH];
+    gifPathForAnim(anim_path, gif_path, sizeof(gif_path));
+    Entry* entry = findMutable(gif_path);
+    if (entry == nullptr) {
+        return false;
+    }
+    entry->has_anim = true;
+    return true;
+}
+
+// Marks the entry for path as seen, probing the gif again if it changed. Returns false if the gif isn't in the index.
+bool GifIndex::scanKnownFile(const char* vfs_path, const char* path) {
+    Entry* entry = findMutable(path);
+    if (entry == nullptr) {
+        return false;
+    }
+    struct stat st;
+    if (stat(vfs_path, &st) != 0) {
+        return true;
+    }
+    if (entry->size != (uint32_t)st.st_size || entry->mtime != (uint32_t)st.st_mtime) {
+        // Without the memory to probe, the stale entry is kept and the next refresh probes it
+        if (startProbing()) {
+            GifPlayer::GifInfo info;
+            if (!GifPlayer::probe(path, &info)) {
+                return true;
+            }
+            updateEntry(*entry, st.st_size, st.st_mtime, info);
+        }
+    }
+    entry->seen = true;
+    return true;
+}
+
+// Not in the lookup until the refresh finishes, but each file is only listed once
+void GifIndex::scanNewFile(const char* vfs_path, const char* path) {
+    struct stat st;
+    GifPlayer::GifInfo info;
+    if (!startProbing() || stat(vfs_path, &st) != 0 || !GifPlayer::probe(path, &info)) {
+        return;
+    }
+    addEntry(path, strlen(path));
+    updateEntry(entries_.back(), st.st_size, st.st_mtime, info);
+}
+
+// Sets up the probe decoder on the first gif a refresh has to probe, and reuses it for the rest
+bool GifIndex::startProbing() {
+    if (probe_state_ == ProbeState::IDLE) {
+        if (GifPlayer::begin_probing()) {
+            probe_state_ = ProbeState::PROBING;
+        } else {
+            log_n("Not enough memory to probe gifs; new and changed ones are left for the next refresh");
+            probe_state_ = ProbeState::OUT_OF_MEMORY;
+        }
+    }
+    return probe_state_ == ProbeState::PROBING;
+}
+
+void GifIndex::updateEntry(Entry& entry, uint32_t size, uint32_t mtime, const GifPlayer::GifInfo& info) {
+    probed_++;
+    dirty_ = true;
+    entry.size = size;
+    entry.mtime = mtime;
+    entry.width = info.width;
+    entry.height = info.height;
+    entry.frame_count = info.frame_count;
+    entry.duration_ms = info.duration_ms;
+    // The file changed, so any earlier measurement no longer applies
+    entry.decode_us = 0;
+    entry.seen = true;
+}
+
+// Drops gifs under prefix that the refresh didn't find, compacting the path pool if any were removed
+void GifIndex::removeUnseen(const char* prefix) {
+    size_t prefix_length = strlen(prefix);
+    size_t kept = 0;
+    size_t path_bytes = 0;
+    for (const Entry& entry : entries_) {
+        if (entry.seen || !under(entry, prefix, prefix_length)) {
+            kept++;
+            path_bytes += entry.path_length + 1;
+        }
+    }
+    if (kept == entries_.size()) {
+        return;
+    }
+    std::vector<char> paths;
+    std::vector<Entry> entries;
+    paths.reserve(path_bytes);
+    entries.reserve(kept);
+    for (const Entry& entry : entries_) {
+        if (entry.seen || !under(entry, prefix, prefix_length)) {
+            entries.push_back(entry);
+        }
+    }
+    for (Entry& entry : entries) {
+        const char* entry_path = path(entry);
+        entry.path_offset = paths.size();
+        paths.insert(paths.end(), entry_path, entry_path + entry.path_length + 1);
+    }
+    paths_.swap(paths);
+    entries_.swap(entries);
+    dirty_ = true;
+}
+
+int GifIndex::list(const char* dir, Playlist& out_files) const {
+    char prefix[GIF_INDEX_MAX_PATH];
+    size_t prefix_length = snprintf(prefix, sizeof(prefix), "%s/", dir);
+
+    // Size the playlist exactly before filling it, so it is a single allocation
+    size_t pool_bytes = 0;
+    size_t count = 0;
+    for (const Entry& entry : entries_) {
+        if (under(entry, prefix, prefix_length) && pool_bytes + entry.path_length + 1 <= PLAYLIST_MAX_POOL_BYTES) {
+            pool_bytes += entry.path_length + 1;
+            count++;
+        }
+    }
+    if (!out_files.reset(pool_bytes, count)) {
+        return 0;
+    }
+    for (const Entry& entry : entries_) {
+        if (under(entry, prefix, prefix_length) && !out_files.add(path(entry))) {
+            log_n("Playlist for %s is full, skipping the remaining gifs", dir);
+            break;
+        }
+    }
+    return out_files.size();
+}
+
+bool GifIndex::under(const Entry& entry, const char* prefix, size_t prefix_length) const {
+    return entry.path_length > prefix_length && strncmp(path(entry), prefix, prefix_length) == 0;
+}
+
+const GifIndex::Entry* GifIndex::find(const char* path) const {
+    auto it = std::lower_bound(sorted_.begin(), sorted_.end(), path, [this](uint32_t index, const char* p) {
+        return strcmp(this->path(entries_[index]), p) < 0;
+    });
+    if (it == sorted_.end() || strcmp(this->path(entries_[*it]), path) != 0) {
+        return nullptr;
+    }
+    return &entries_[*it];
+}
+
+GifIndex::Entry* GifIndex::findMutable(const char* path) {
+    return const_cast<Entry*>(find(path));
+}
+
+void GifIndex::addEntry(const char* path, size_t length) {
+    Entry entry = {};
+    entry.path_offset = paths_.size();
+    entry.path_length = length;
+    paths_.insert(paths_.end(), path, path + length);
+    paths_.push_back('\0');
+    entries_.push_back(entry);
+}
+
+void GifIndex::recordDecodeCost(const char* path, uint32_t decode_us) {
+    Entry* entry = findMutable(path);
+    if (entry == nullptr || decode_us == 0) {
+        return;
+    }
+    // Only the first measurement is stored, so the index isn't rewritten every time a gif plays
+    if (entry->decode_us == 0) {
+        entry->decode_us = decode_us;
+        dirty_ = true;
+    }
+}
+
+void GifIndex::rebuildLookup() {
+    if (sorted_.capacity() != entries_.size()) {
+        // Exactly sized rather than grown, as the index stays allocated for as long as the gifs play
+        std::vector<uint32_t>().swap(sorted_);
+        sorted_.reserve(entries_.size());
+    }
+    sorted_.resize(entries_.size());
+    for (size_t i = 0; i < entries_.size(); i++) {
+        sorted_[i] = i;
+    }
+    std::sort(sorted_.begin(), sorted_.end(), [this](uint32_t a, uint32_t b) {
+        return strcmp(path(entries_[a]), path(entries_[b])) < 0;
+    });
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include <vector>
+
+#include "gif_player.h"
+#include "playlist.h"
+
+#define GIF_INDEX_PATH "/gifs/index.bin"
+#define GIF_INDEX_MAX_DEPTH 4          // Folder levels below a library directory that are scanned
+#define GIF_INDEX_MAX_PATH 256
+
+// Metadata for every gif in the library, kept in a binary file on the card so boot doesn't have to open each gif.
+// The index is loaded with one sequential read, then refreshed from directory listings: only files that are new or
+// whose size or modification time changed are opened and probed. The refresh also notes which gifs have a
+// pre-transcoded .anim next to them, so playing one doesn't have to look for it on the card first.
+class GifIndex {
+    public:
+        struct Entry {
+            uint32_t path_offset;   // into the path pool, NUL terminated
+            uint16_t path_length;
+            uint32_t size;
+            uint32_t mtime;
+            uint16_t width;
+            uint16_t height;
+            uint16_t frame_count;
+            uint32_t duration_ms;   // one loop
+            uint32_t decode_us;     // average render time per frame when last played; 0 if not played yet
+            bool seen;              // found by the current refresh; not stored
+            bool has_anim;          // an .anim of the same name is next to it, as of the last refresh; not stored
+        };
+
+        GifIndex() {};
+        GifIndex(GifIndex const&)=delete;
+        GifIndex& operator=(GifIndex const&)=delete;
+
+        static bool isGifPath(const char* path);
+        static bool isAnimPath(const char* path);
+
+        bool load(fs::FS& fs, const char* index_path);
+        // Writes the index if anything changed since it was loaded or saved
+        bool save(fs::FS& fs, const char* index_path);
+
+        // Brings the entries under dir, including up to GIF_INDEX_MAX_DEPTH levels of subfolders, up to date with the
+        // card, along with which of them have an .anim; mount_point is where fs is mounted in the VFS. Returns the
+        // number of gifs that had to be probed, or -1 if the directory couldn't be listed.
+        int refresh(const char* mount_point, const char* dir);
+
+        // Fills out_files with the paths of the gifs under dir, in index order
+        int list(const char* dir, Playlist& out_files) const;
+
+        const Entry* find(const char* path) const;
+        const char* path(const Entry& entry) const { return &paths_[entry.path_offset]; }
+        void recordDecodeCost(const char* path, uint32_t decode_us);
+
+    private:
+        enum class ProbeState : uint8_t {
+            IDLE,
+            PROBING,
+            OUT_OF_MEMORY,
+        };
+
+        Entry* findMutable(const char* path);
+        void addEntry(const char* path, size_t length);
+        bool under(const Entry& entry, const char* prefix, size_t prefix_length) const;
+        bool scanKnownFile(const char* vfs_path, const char* path);
+        bool markAnim(const char* anim_path);
+        void scanNewFile(const char* vfs_path, const char* path);
+        bool startProbing();
+        void updateEntry(Entry& entry, uint32_t size, uint32_t mtime, const GifPlayer::GifInfo& info);
+        void removeUnseen(const char* prefix);
+        void rebuildLookup();
+
+        // All paths back to back, so thousands of gifs cost one allocation rather than one each. The pool and entries
+        // are sized exactly on load and grow at most once per refresh, by the number of new gifs it found.
+        std::vector<char> paths_;
+        std::vector<Entry> entries_;
+        // Entry indices ordered by path, for binary search
+        std::vector<uint32_t> sorted_;
+        bool dirty_ = false;
+        int probed_ = 0;
+        // Whether this refresh set up the probe decoder, which is shared by all the gifs it probes
+        ProbeState probe_state_ = ProbeState::IDLE;
+};
@@ -1,32 +1,80 @@
 #include "gif_player.h"
 
 #include <AnimatedGIF.h>
+#include <esp_heap_caps.h>
 #include <SD_MMC.h>
 #include <TFT_eSPI.h>
 
+#include <new>
+
+#include "cycle_timer.h"
+#include "decode_task.h"
+#include "overlay.h"
+#include "palette_expand.h"
+#include "prefetch_task.h"
+#include "presenter_task.h"
+
 AnimatedGIF GifPlayer::gif;
 TFT_eSPI* GifPlayer::tft;
 
-File GifPlayer::FSGifFile; // temp gif file holder
+BlockReader GifPlayer::reader;
+GifCache GifPlayer::cache;
+AnimatedGIF* GifPlayer::probe_gif = nullptr;
+BlockReader* GifPlayer::probe_reader = nullptr;
+FrameCache GifPlayer::frame_cache;
+const FrameCache::Entry* GifPlayer::replay = nullptr;
+size_t GifPlayer::replay_index;
+
+uint16_t GifPlayer::usTemp[BUFFER_SIZE];
+
+bool GifPlayer::dma_enabled = false;
+uint16_t* GifPlayer::dma_lines[DMA_LINE_BUFFERS];
+int GifPlayer::dma_line_width;
+int GifPlayer::dma_index;
+
+PresenterTask* GifPlayer::presenter = nullptr;
+PrefetchTask* GifPlayer::prefetcher = nullptr;
+DecodeTask* GifPlayer::decoder = nullptr;
+bool GifPlayer::frame_in_progress = false;
+bool GifPlayer::abort_frame = false;
 
-#ifdef USE_DMA
-uint16_t GifPlayer::usTemp[2][BUFFER_SIZE]; // Global to support DMA use
-#else
-uint16_t GifPlayer::usTemp[1][BUFFER_SIZE];    // Global to support DMA use
-#endif
-bool GifPlayer::dmaBuf;
+OverlayWindow GifPlayer::overlay_window;
 
 int GifPlayer::frame_delay;
-int GifPlayer::max_line = -1;
+
+bool GifPlayer::upscale = false;
+int GifPlayer::scale = 1;
+
+uint16_t* GifPlayer::frame_buffer = nullptr;
+int GifPlayer::dirty_x0;
+int GifPlayer::dirty_y0;
+int GifPlayer::dirty_x1 = -1;
+int GifPlayer::dirty_y1 = -1;
+bool GifPlayer::composite = false;
+bool GifPlayer::skip_draw = false;
+bool GifPlayer::overlay_touched = false;
+uint32_t GifPlayer::overlay_changes = 0;
+bool GifPlayer::force_dirty = false;
+
+const GifPlayer::DrawKernel* GifPlayer::draw_kernels = GifPlayer::kDrawKernels[DRAW_DIRECT];
+int GifPlayer::draw_width = DISPLAY_WIDTH;
+int GifPlayer::draw_scale = 1;
+
+GifPlayer::FrameStats GifPlayer::last_frame_stats;
+GifPlayer::FrameStats GifPlayer::total_stats;
+uint32_t GifPlayer::frame_start_us;
+BlockReader::Stats GifPlayer::frame_io_start;
+uint32_t GifPlayer::palette_cycles;
+uint32_t GifPlayer::push_cycles;
+PerfCounters GifPlayer::perf;
 
 
 void * GifPlayer::GIFOpenFile(const char *fname, int32_t *pSize)
 {
   //log_d("GIFOpenFile( %s )\n", fname );
-  FSGifFile = SD_MMC.open(fname);
-  if (FSGifFile) {
-    *pSize = FSGifFile.size();
-    return (void *)&FSGifFile;
+  if ((prefetcher != nullptr && prefetcher->take(fname, reader)) || reader.open(SD_MMC, fname)) {
+    *pSize = reader.size();
+    return (void *)&reader;
   }
   return NULL;
 }
@@ -34,192 +82,1031 @@ void * GifPlayer::GIFOpenFile(const char *fname, int32_t *pSize)
 
 void GifPlayer::GIFCloseFile(void *pHandle)
 {
-  File *f = static_cast<File *>(pHandle);
-  if (f != NULL)
-     f->close();
+  BlockReader *r = static_cast<BlockReader *>(pHandle);
+  if (r != NULL)
+     r->close();
 }
 
 
 int32_t GifPlayer::GIFReadFile(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen)
 {
-  int32_t iBytesRead;
-  iBytesRead = iLen;
-  File *f = static_cast<File *>(pFile->fHandle);
-  // Note: If you read a file all the way to the last byte, seek() stops working
-  if ((pFile->iSize - pFile->iPos) < iLen)
-      iBytesRead = pFile->iSize - pFile->iPos - 1; // <-- ugly work-around
-  if (iBytesRead <= 0)
-      return 0;
-  iBytesRead = (int32_t)f->read(pBuf, iBytesRead);
-  pFile->iPos = f->position();
+  BlockReader *r = static_cast<BlockReader *>(pFile->fHandle);
+  int32_t iBytesRead = r->read(pBuf, iLen);
+  pFile->iPos = r->position();
   return iBytesRead;
 }
 
 
 int32_t GifPlayer::GIFSeekFile(GIFFILE *pFile, int32_t iPosition)
 {
-  int i = micros();
-  File *f = static_cast<File *>(pFile->fHandle);
-  f->seek(iPosition);
-  pFile->iPos = (int32_t)f->position();
-  i = micros() - i;
-  //log_d("Seek time = %d us\n", i);
+  BlockReader *r = static_cast<BlockReader *>(pFile->fHandle);
+  r->seek(iPosition);
+  pFile->iPos = r->position();
   return pFile->iPos;
 }
 
 
 
 
+// Every push opens a window first, so the first window of a frame is also when its first pixels go out
+inline void GifPlayer::count_window() {
+  if (last_frame_stats.window_commands++ == 0)
+    last_frame_stats.first_push_us = micros() - frame_start_us;
+}
+
+// Every path writes a whole clipped line without splitting it into BUFFER_SIZE chunks
+static_assert(DISPLAY_WIDTH <= BUFFER_SIZE, "usTemp must hold a full display line");
+
+// Kernels by draw target and pixel mode. Each is a separate instantiation, so the rendering path and the
+// disposal/transparency handling are resolved at compile time instead of per line or per pixel.
+const GifPlayer::DrawKernel GifPlayer::kDrawKernels[DRAW_TARGETS][PIXEL_MODES] = {
+  {
+    &GifPlayer::draw_direct_line<DRAW_DIRECT, PIXELS_OPAQUE>,
+    &GifPlayer::draw_direct_line<DRAW_DIRECT, PIXELS_TRANSPARENT>,
+    &GifPlayer::draw_direct_line<DRAW_DIRECT, PIXELS_RESTORE_BACKGROUND>,
+  },
+  {
+    &GifPlayer::draw_direct_line<DRAW_DMA, PIXELS_OPAQUE>,
+    &GifPlayer::draw_direct_line<DRAW_DMA, PIXELS_TRANSPARENT>,
+    &GifPlayer::draw_direct_line<DRAW_DMA, PIXELS_RESTORE_BACKGROUND>,
+  },
+  {
+    &GifPlayer::draw_direct_line<DRAW_PRESENTER, PIXELS_OPAQUE>,
+    &GifPlayer::draw_direct_line<DRAW_PRESENTER, PIXELS_TRANSPARENT>,
+    &GifPlayer::draw_direct_line<DRAW_PRESENTER, PIXELS_RESTORE_BACKGROUND>,
+  },
+  {
+    &GifPlayer::draw_buffer_line<PIXELS_OPAQUE, false>,
+    &GifPlayer::draw_buffer_line<PIXELS_TRANSPARENT, false>,
+    &GifPlayer::draw_buffer_line<PIXELS_RESTORE_BACKGROUND, false>,
+  },
+  {
+    &GifPlayer::draw_buffer_line<PIXELS_OPAQUE, true>,
+    &GifPlayer::draw_buffer_line<PIXELS_TRANSPARENT, true>,
+    &GifPlayer::draw_buffer_line<PIXELS_RESTORE_BACKGROUND, true>,
+  },
+};
+
+// Upscaled lines by scale (from 2), then direct (through present()), back buffer and back buffer repaint
+#define SCALED_KERNELS(S, TARGET) { \
+    &GifPlayer::draw_scaled_line<S, TARGET, PIXELS_OPAQUE>, \
+    &GifPlayer::draw_scaled_line<S, TARGET, PIXELS_TRANSPARENT>, \
+    &GifPlayer::draw_scaled_line<S, TARGET, PIXELS_RESTORE_BACKGROUND>, \
+  }
+const GifPlayer::DrawKernel GifPlayer::kScaledKernels[MAX_UPSCALE - 1][3][PIXEL_MODES] = {
+  {
+    SCALED_KERNELS(2, DRAW_DIRECT),
+    SCALED_KERNELS(2, DRAW_BUFFER),
+    SCALED_KERNELS(2, DRAW_BUFFER_REPAINT),
+  },
+  {
+    SCALED_KERNELS(3, DRAW_DIRECT),
+    SCALED_KERNELS(3, DRAW_BUFFER),
+    SCALED_KERNELS(3, DRAW_BUFFER_REPAINT),
+  },
+};
+#undef SCALED_KERNELS
+
+// Pick the kernel row for the upcoming frame; the target can only change between frames
+void GifPlayer::select_draw_kernels() {
+    DrawTarget target;
+    if (frame_buffer != nullptr) {
+        target = force_dirty ? DRAW_BUFFER_REPAINT : DRAW_BUFFER;
+    } else if (presenter != nullptr) {
+        target = DRAW_PRESENTER;
+    } else if (dma_lines[0] != nullptr) {
+        target = DRAW_DMA;
+    } else {
+        target = DRAW_DIRECT;
+    }
+    if (scale > 1) {
+        // Scaled lines go through present() rather than the per-line DMA buffers
+        int row = target == DRAW_BUFFER ? 1 : target == DRAW_BUFFER_REPAINT ? 2 : 0;
+        draw_kernels = kScaledKernels[scale - 2][row];
+    } else {
+        draw_kernels = kDrawKernels[target];
+    }
+    draw_scale = scale;
+    draw_width = DISPLAY_WIDTH / scale;
+}
+
 // From AnimatedGIF TFT_eSPI_memory example
-  
-// Draw a line of image directly on the LCD
+
+// Clip a line to the display and hand it to the kernel for the current target and the line's pixel mode
 void GifPlayer::GIFDraw(GIFDRAW *pDraw)
 {
-  uint8_t *s;
-  uint16_t *d, *usPalette;
-  int x, y, iWidth, iCount;
+  int iWidth, y;
+
+  // A frame decoded in slices hands control back between lines, and one being stopped is decoded to its end unseen
+  if (frame_in_progress)
+    decoder->checkpoint();
+  if (abort_frame)
+    return;
 
-  // Displ;ay bounds chech and cropping
+  // Display bounds check and cropping, in gif pixels horizontally and display lines vertically
   iWidth = pDraw->iWidth;
-  if (iWidth + pDraw->iX > DISPLAY_WIDTH)
-    iWidth = DISPLAY_WIDTH - pDraw->iX;
-  usPalette = pDraw->pPalette;
-  y = pDraw->iY + pDraw->y; // current line
-  if (y >= DISPLAY_HEIGHT || pDraw->iX >= DISPLAY_WIDTH || iWidth < 1 || (max_line > -1 && y > max_line))
+  if (iWidth + pDraw->iX > draw_width)
+    iWidth = draw_width - pDraw->iX;
+  y = (pDraw->iY + pDraw->y) * draw_scale; // current line
+  if (y >= DISPLAY_HEIGHT || pDraw->iX >= draw_width || iWidth < 1)
     return;
+  last_frame_stats.lines++;
 
-  // Old image disposal
-  s = pDraw->pPixels;
+  PixelMode mode = PIXELS_OPAQUE;
   if (pDraw->ucDisposalMethod == 2) // restore to background color
+    mode = PIXELS_RESTORE_BACKGROUND;
+  else if (pDraw->ucHasTransparency)
+    mode = PIXELS_TRANSPARENT;
+  draw_kernels[mode](pDraw, iWidth, y);
+} /* GIFDraw() */
+
+// Draw a line of image directly on the LCD, through DMA or through the presenter
+template<GifPlayer::DrawTarget TARGET, GifPlayer::PixelMode MODE>
+void GifPlayer::draw_direct_line(GIFDRAW *pDraw, int iWidth, int y)
+{
+  uint8_t *s = pDraw->pPixels;
+  uint16_t *d, *usPalette = pDraw->pPalette;
+  uint8_t ucTransparent = pDraw->ucTransparent;
+  int x, iCount;
+
+  // Old image disposal
+  if (MODE == PIXELS_RESTORE_BACKGROUND)
   {
+    uint8_t ucBackground = pDraw->ucBackground;
     for (x = 0; x < iWidth; x++)
     {
-      if (s[x] == pDraw->ucTransparent)
-        s[x] = pDraw->ucBackground;
+      if (s[x] == ucTransparent)
+        s[x] = ucBackground;
     }
-    pDraw->ucHasTransparency = 0;
   }
 
   // Apply the new pixels to the main image
-  if (pDraw->ucHasTransparency) // if transparency used
+  if (MODE == PIXELS_TRANSPARENT)
   {
-    uint8_t *pEnd, c, ucTransparent = pDraw->ucTransparent;
-    pEnd = s + iWidth;
+    uint8_t *pEnd = s + iWidth;
     x = 0;
-    iCount = 0; // count non-transparent pixels
-    while (x < iWidth)
+    while (s < pEnd)
     {
-      c = ucTransparent - 1;
-      d = &usTemp[0][0];
-      while (c != ucTransparent && s < pEnd && iCount < BUFFER_SIZE )
+      // Skip a run of transparent pixels
+      while (s < pEnd && *s == ucTransparent)
       {
-        c = *s++;
-        if (c == ucTransparent) // done, stop
-        {
-          s--; // back up to treat it like transparent
-        }
-        else // opaque
-        {
-          *d++ = usPalette[c];
-          iCount++;
-        }
-      } // while looking for opaque pixels
+        s++;
+        x++;
+      }
+      // Find the following run of opaque pixels; it always fits usTemp
+      uint8_t *pRun = s;
+      while (s < pEnd && *s != ucTransparent)
+        s++;
+      iCount = s - pRun;
       if (iCount) // any opaque pixels?
       {
         // DMA would degrtade performance here due to short line segments
-        tft->setAddrWindow(pDraw->iX + x, y, iCount, 1);
-        tft->pushPixels(usTemp, iCount);
+        {
+          CycleTimer timer(palette_cycles);
+          palette_expand(usTemp, pRun, usPalette, iCount);
+        }
+        present(pDraw->iX + x, y, iCount, 1, usTemp);
         x += iCount;
-        iCount = 0;
       }
-      // no, look for a run of transparent pixels
-      c = ucTransparent;
-      while (c == ucTransparent && s < pEnd)
+    }
+    return;
+  }
+
+  if (TARGET == DRAW_PRESENTER)
+  {
+    // Translate straight into the presenter's ring; the other core pushes it to the panel
+    PresentLine *line;
+    {
+      CycleTimer timer(push_cycles);
+      line = presenter->acquireLine();
+    }
+    {
+      CycleTimer timer(palette_cycles);
+      palette_expand(line->pixels, s, usPalette, iWidth);
+      if (Overlay::covers(y))
+        Overlay::blend(pDraw->iX, y, iWidth, line->pixels, line->pixels);
+    }
+    line->x = pDraw->iX;
+    line->y = y;
+    line->width = iWidth;
+    line->height = 1;
+    capture(pDraw->iX, y, iWidth, 1, line->pixels, iWidth);
+    presenter->submitLine();
+    count_window();
+    last_frame_stats.pushed_bytes += iWidth * sizeof(uint16_t);
+    return;
+  }
+
+  if (TARGET == DRAW_DMA && iWidth <= dma_line_width)
+  {
+    // Translate into the next free line buffer while the previous line is still being sent, so decoding
+    // of this line overlapped the transfer of the last one
+    d = dma_lines[dma_index];
+    {
+      CycleTimer timer(palette_cycles);
+      palette_expand(d, s, usPalette, iWidth);
+      if (Overlay::covers(y))
+        Overlay::blend(pDraw->iX, y, iWidth, d, d);
+    }
+    capture(pDraw->iX, y, iWidth, 1, d, iWidth);
+
+    wait_for_dma();
+    {
+      CycleTimer timer(push_cycles);
+      tft->setAddrWindow(pDraw->iX, y, iWidth, 1);
+      tft->pushPixelsDMA(d, iWidth);
+    }
+    dma_index = (dma_index + 1) % DMA_LINE_BUFFERS;
+    count_window();
+    last_frame_stats.pushed_bytes += iWidth * sizeof(uint16_t);
+    return;
+  }
+
+  // Translate the 8-bit pixels through the RGB565 palette (already byte reversed)
+  {
+    CycleTimer timer(palette_cycles);
+    palette_expand(usTemp, s, usPalette, iWidth);
+    if (Overlay::covers(y))
+      Overlay::blend(pDraw->iX, y, iWidth, usTemp, usTemp);
+  }
+
+  // 57.0 fps
+  if (TARGET == DRAW_DMA)
+    wait_for_dma();
+  {
+    CycleTimer timer(push_cycles);
+    tft->setAddrWindow(pDraw->iX, y, iWidth, 1);
+    tft->pushPixels(usTemp, iWidth);
+  }
+  capture(pDraw->iX, y, iWidth, 1, usTemp, iWidth);
+  count_window();
+  last_frame_stats.pushed_bytes += iWidth * sizeof(uint16_t);
+}
+
+// Draw a line of image into the back buffer, tracking which pixels actually changed. REPAINT treats every
+// drawn pixel as changed, for when the panel contents don't match the buffer.
+template<GifPlayer::PixelMode MODE, bool REPAINT>
+void GifPlayer::draw_buffer_line(GIFDRAW *pDraw, int iWidth, int y)
+{
+  uint8_t *s = pDraw->pPixels;
+  uint16_t *usPalette = pDraw->pPalette;
+  uint16_t *d = &frame_buffer[y * DISPLAY_WIDTH + pDraw->iX];
+  uint8_t ucTransparent = pDraw->ucTransparent;
+  uint8_t ucBackground = pDraw->ucBackground;
+  int first = -1;
+  int last = -1;
+
+  {
+    CycleTimer timer(palette_cycles);
+    if (REPAINT && MODE == PIXELS_OPAQUE)
+    {
+      // Nothing to compare against or skip, so this is a plain palette expansion
+      palette_expand(d, s, usPalette, iWidth);
+      first = 0;
+      last = iWidth - 1;
+    }
+    else
+    {
+      for (int x = 0; x < iWidth; x++)
       {
-        c = *s++;
-        if (c == ucTransparent)
-          x++;
-        else
-          s--;
+        uint8_t c = s[x];
+        if (MODE == PIXELS_TRANSPARENT && c == ucTransparent)
+          continue;
+        if (MODE == PIXELS_RESTORE_BACKGROUND && c == ucTransparent)
+          c = ucBackground;
+        uint16_t color = usPalette[c];
+        if (REPAINT || d[x] != color)
+        {
+          d[x] = color;
+          if (first < 0)
+            first = x;
+          last = x;
+        }
       }
     }
   }
+
+  if (first < 0)
+    return;
+  if (composite && !skip_draw)
+  {
+    // Send the changed span of this line as one transfer, with transparent pixels filled in from the shadow copy
+    present(pDraw->iX + first, y, last - first + 1, 1, &d[first]);
+  }
   else
   {
-    s = pDraw->pPixels;
+    mark_dirty(pDraw->iX + first, y, pDraw->iX + last, y);
+  }
+}
+
+// Draw a line of image at SCALE times its size: pixels are repeated horizontally while expanding the palette, and
+// the line is repeated for SCALE display lines
+template<int SCALE, GifPlayer::DrawTarget TARGET, GifPlayer::PixelMode MODE>
+void GifPlayer::draw_scaled_line(GIFDRAW *pDraw, int iWidth, int y)
+{
+  uint8_t *s = pDraw->pPixels;
+  uint16_t *usPalette = pDraw->pPalette;
+  uint8_t ucTransparent = pDraw->ucTransparent;
+  uint8_t ucBackground = pDraw->ucBackground;
+  int x0 = pDraw->iX * SCALE;
+  // The last gif line may only partly fit on the display
+  int rows = min(SCALE, DISPLAY_HEIGHT - y);
+  int x, iCount;
 
-    // Unroll the first pass to boost DMA performance
-    // Translate the 8-bit pixels through the RGB565 palette (already byte reversed)
-    if (iWidth <= BUFFER_SIZE)
-      for (iCount = 0; iCount < iWidth; iCount++) usTemp[dmaBuf][iCount] = usPalette[*s++];
+  if (TARGET == DRAW_BUFFER || TARGET == DRAW_BUFFER_REPAINT)
+  {
+    uint16_t *d = &frame_buffer[y * DISPLAY_WIDTH + x0];
+    int first = -1;
+    int last = -1;
+    {
+      CycleTimer timer(palette_cycles);
+      for (x = 0; x < iWidth; x++)
+      {
+        uint8_t c = s[x];
+        if (MODE == PIXELS_TRANSPARENT && c == ucTransparent)
+          continue;
+        if (MODE == PIXELS_RESTORE_BACKGROUND && c == ucTransparent)
+          c = ucBackground;
+        uint16_t color = usPalette[c];
+        uint16_t *block = &d[x * SCALE];
+        // Blocks are always written whole, so their first pixel stands for the rest
+        if (TARGET == DRAW_BUFFER && block[0] == color)
+          continue;
+        for (int r = 0; r < rows; r++)
+        {
+          for (int i = 0; i < SCALE; i++)
+            block[r * DISPLAY_WIDTH + i] = color;
+        }
+        if (first < 0)
+          first = x;
+        last = x;
+      }
+    }
+
+    if (first < 0)
+      return;
+    int span_x = x0 + first * SCALE;
+    int span_w = (last - first + 1) * SCALE;
+    if (composite && !skip_draw)
+    {
+      for (int r = 0; r < rows; r++)
+        present(span_x, y + r, span_w, r == 0 ? rows : 0, &d[r * DISPLAY_WIDTH + first * SCALE]);
+    }
     else
-      for (iCount = 0; iCount < BUFFER_SIZE; iCount++) usTemp[dmaBuf][iCount] = usPalette[*s++];
+    {
+      mark_dirty(span_x, y, span_x + span_w - 1, y + rows - 1);
+    }
+    return;
+  }
 
-#ifdef USE_DMA // 71.6 fps (ST7796 84.5 fps)
-    tft->dmaWait();
-    tft->setAddrWindow(pDraw->iX, y, iWidth, 1);
-    tft->pushPixelsDMA(&usTemp[dmaBuf][0], iCount);
-    dmaBuf = !dmaBuf;
-#else // 57.0 fps
-    tft->setAddrWindow(pDraw->iX, y, iWidth, 1);
-    tft->pushPixels(&usTemp[0][0], iCount);
-#endif
+  // Old image disposal
+  if (MODE == PIXELS_RESTORE_BACKGROUND)
+  {
+    for (x = 0; x < iWidth; x++)
+    {
+      if (s[x] == ucTransparent)
+        s[x] = ucBackground;
+    }
+  }
 
-    iWidth -= iCount;
-    // Loop if pixel buffer smaller than width
-    while (iWidth > 0)
+  if (MODE == PIXELS_TRANSPARENT)
+  {
+    uint8_t *pEnd = s + iWidth;
+    x = 0;
+    while (s < pEnd)
     {
-      // Translate the 8-bit pixels through the RGB565 palette (already byte reversed)
-      if (iWidth <= BUFFER_SIZE)
-        for (iCount = 0; iCount < iWidth; iCount++) usTemp[dmaBuf][iCount] = usPalette[*s++];
-      else
-        for (iCount = 0; iCount < BUFFER_SIZE; iCount++) usTemp[dmaBuf][iCount] = usPalette[*s++];
-
-#ifdef USE_DMA
-      tft->dmaWait();
-      tft->pushPixelsDMA(&usTemp[dmaBuf][0], iCount);
-      dmaBuf = !dmaBuf;
-#else
-      tft->pushPixels(&usTemp[0][0], iCount);
-#endif
-      iWidth -= iCount;
+      while (s < pEnd && *s == ucTransparent)
+      {
+        s++;
+        x++;
+      }
+      uint8_t *pRun = s;
+      while (s < pEnd && *s != ucTransparent)
+        s++;
+      iCount = s - pRun;
+      if (iCount)
+      {
+        {
+          CycleTimer timer(palette_cycles);
+          palette_expand_scaled<SCALE>(usTemp, pRun, usPalette, iCount);
+        }
+        present_rows(x0 + x * SCALE, y, iCount * SCALE, rows, usTemp);
+        x += iCount;
+      }
     }
+    return;
   }
-} /* GIFDraw() */
 
+  {
+    CycleTimer timer(palette_cycles);
+    palette_expand_scaled<SCALE>(usTemp, s, usPalette, iWidth);
+  }
+  present_rows(x0, y, iWidth * SCALE, rows, usTemp);
+}
+
+void GifPlayer::mark_dirty(int x0, int y0, int x1, int y1) {
+    if (dirty_x1 < dirty_x0) {
+        dirty_x0 = x0;
+        dirty_y0 = y0;
+        dirty_x1 = x1;
+        dirty_y1 = y1;
+        return;
+    }
+    dirty_x0 = min(dirty_x0, x0);
+    dirty_y0 = min(dirty_y0, y0);
+    dirty_x1 = max(dirty_x1, x1);
+    dirty_y1 = max(dirty_y1, y1);
+}
+
+// Push the dirty bounding box of the back buffer using a single address window
+void GifPlayer::flush_frame_buffer() {
+    if (dirty_x1 >= dirty_x0) {
+        int w = dirty_x1 - dirty_x0 + 1;
+        int h = dirty_y1 - dirty_y0 + 1;
+        for (int y = dirty_y0; y <= dirty_y1; y++) {
+            // Only the first row opens the address window; the rest continue it
+            present(dirty_x0, y, w, y == dirty_y0 ? h : 0, &frame_buffer[y * DISPLAY_WIDTH + dirty_x0]);
+        }
+    }
+    dirty_x0 = 0;
+    dirty_y0 = 0;
+    dirty_x1 = -1;
+    dirty_y1 = -1;
+}
+
+
+
+
+void GifPlayer::wait_for_dma() {
+    if (dma_lines[0] == nullptr) {
+        return;
+    }
+    uint32_t start = micros();
+    tft->dmaWait();
+    last_frame_stats.dma_wait_us += micros() - start;
+}
+
+// Push a run of pixels, opening a new address window of h lines first unless h is 0. pixels is left as it is;
+// lines under the overlay are blended on the way out.
+void GifPlayer::present(int x, int y, int w, int h, const uint16_t* pixels) {
+    if (presenter != nullptr) {
+        CycleTimer timer(push_cycles);
+        PresentLine* line = presenter->acquireLine();
+        if (Overlay::covers(y)) {
+            Overlay::blend(x, y, w, pixels, line->pixels);
+        } else {
+            memcpy(line->pixels, pixels, w * sizeof(uint16_t));
+        }
+        line->x = x;
+        line->y = y;
+        line->width = w;
+        line->height = h;
+        presenter->submitLine();
+    } else {
+        wait_for_dma();
+        CycleTimer timer(push_cycles);
+        if (Overlay::covers(y)) {
+            pixels = Overlay::blend(x, y, w, pixels);
+        }
+        if (h > 0) {
+            tft->setAddrWindow(x, y, w, h);
+        }
+        tft->pushPixels(pixels, w);
+    }
+    capture(x, y, w, h, pixels, w);
+    if (h > 0) {
+        count_window();
+    }
+    last_frame_stats.pushed_bytes += w * sizeof(uint16_t);
+}
+
+// Push the same run of pixels to rows consecutive lines through a single address window
+void GifPlayer::present_rows(int x, int y, int w, int rows, const uint16_t* pixels) {
+    for (int r = 0; r < rows; r++) {
+        present(x, y + r, w, r == 0 ? rows : 0, pixels);
+    }
+}
 
+// Record a push for the frame cache; h of 0 continues the current window
+void GifPlayer::capture(int x, int y, int w, int h, const uint16_t* pixels, int count) {
+    if (!frame_cache.capturing()) {
+        return;
+    }
+    if (h > 0) {
+        frame_cache.captureWindow(x, y, w, h);
+    }
+    frame_cache.capturePixels(pixels, count);
+}
 
+// Push a frame recorded by the frame cache, blending lines under the overlay
+void GifPlayer::replay_frame(const FrameCache::Frame& frame) {
+    const uint16_t* op = frame.ops.data();
+    const uint16_t* end = op + frame.ops.size();
+    while (op < end) {
+        uint16_t token = *op++;
+        if (token == FRAME_CACHE_WINDOW) {
+            int x = op[0];
+            int y = op[1];
+            int w = op[2];
+            int h = op[3];
+            op += 4;
+            tft->setAddrWindow(x, y, w, h);
+            overlay_window.begin(x, y, w, h);
+            count_window();
+            last_frame_stats.pushed_bytes += w * h * sizeof(uint16_t);
+        } else if (token & FRAME_CACHE_RUN) {
+            overlay_window.pushBlock(*op++, token & ~FRAME_CACHE_RUN);
+        } else {
+            overlay_window.pushPixels(op, token);
+            op += token;
+        }
+    }
+}
+
+// Repaint the lines the overlay was set on or removed from since the last frame
+void GifPlayer::refresh_overlay() {
+    int y0, y1;
+    if (!Overlay::take_changed_lines(&y0, &y1)) {
+        return;
+    }
+    if (frame_buffer != nullptr && replay == nullptr) {
+        // Flushed with this frame from the back buffer, blended like any other line
+        mark_dirty(0, y0, DISPLAY_WIDTH - 1, y1);
+    } else {
+        Overlay::paint(tft, y0, y1);
+    }
+}
+
+void GifPlayer::allocate_dma_lines(int width) {
+    dma_line_width = min(width, DISPLAY_WIDTH);
+    dma_index = 0;
+    for (int i = 0; i < DMA_LINE_BUFFERS; i++) {
+        dma_lines[i] = static_cast<uint16_t*>(heap_caps_malloc(dma_line_width * sizeof(uint16_t), MALLOC_CAP_DMA));
+        if (dma_lines[i] == nullptr) {
+            log_n("Failed to allocate DMA line buffers, using blocking transfers");
+            free_dma_lines();
+            return;
+        }
+    }
+}
+
+void GifPlayer::free_dma_lines() {
+    for (int i = 0; i < DMA_LINE_BUFFERS; i++) {
+        heap_caps_free(dma_lines[i]);
+        dma_lines[i] = nullptr;
+    }
+}
+
+// Returns the file contents from the RAM cache, loading it on a miss if it fits. nullptr means play from SD.
+const uint8_t* GifPlayer::load_cached(const char* path, size_t file_size, size_t* size) {
+    // Gifs the cache can't take aren't lookups, so they neither open the file here nor count against the hit rate
+    if (!cache.enabled() || (!cache.contains(path) && !cache.admits(file_size))) {
+        return nullptr;
+    }
+    const uint8_t* data = cache.find(path, size);
+    if (data != nullptr) {
+        return data;
+    }
+
+    uint8_t* buffer = cache.insert(path, file_size);
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+    File file = SD_MMC.open(path);
+    // A size that no longer matches means the file changed since the library was scanned
+    size_t n = file && file.size() == file_size ? file.read(buffer, file_size) : 0;
+    file.close();
+    if (n != file_size) {
+        cache.erase(path);
+        return nullptr;
+    }
+    *size = file_size;
+    return buffer;
+}
+
+bool GifPlayer::start(const char* path, size_t file_size) {
+    total_stats = {};
+    reader.resetStats();
+    replay = frame_cache.find(path);
+    if (replay != nullptr) {
+        // Every frame is already decoded; no need to open the gif at all
+        replay_index = 0;
+        tft->startWrite();
+        return true;
+    }
 
-bool GifPlayer::start(const char* path) {
     gif.begin(BIG_ENDIAN_PIXELS);
 
-    if( ! gif.open( path, GIFOpenFile, GIFCloseFile, GIFReadFile, GIFSeekFile, GIFDraw ) ) {
+    size_t cached_size = 0;
+    const uint8_t* cached = load_cached(path, file_size, &cached_size);
+    int opened;
+    if (cached != nullptr) {
+        // AnimatedGIF only reads from the buffer, despite the non-const signature
+        opened = gif.open(const_cast<uint8_t*>(cached), cached_size, GIFDraw);
+    } else {
+        opened = gif.open( path, GIFOpenFile, GIFCloseFile, GIFReadFile, GIFSeekFile, GIFDraw );
+    }
+    if( ! opened ) {
         log_n("Could not open gif %s", path );
         return false;
     }
 
+    scale = 1;
+    if (upscale) {
+        scale = constrain(min(DISPLAY_WIDTH / gif.getCanvasWidth(), DISPLAY_HEIGHT / gif.getCanvasHeight()), 1, MAX_UPSCALE);
+    }
+
+    if (dma_enabled && presenter == nullptr && scale == 1) {
+        allocate_dma_lines(gif.getCanvasWidth());
+    }
+
+    if (frame_buffer != nullptr && composite) {
+        // The shadow copy doesn't match the panel yet, so send every drawn pixel of the first frame
+        force_dirty = true;
+    } else if (frame_buffer != nullptr) {
+        // The panel contents are unknown (credits, log bar, previous gif), so repaint everything on the first frame
+        memset(frame_buffer, 0, DISPLAY_WIDTH * DISPLAY_HEIGHT * sizeof(uint16_t));
+        mark_dirty(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);
+    }
+    frame_cache.beginCapture(path);
+
     tft->startWrite();
     return true;
 }
 
-bool GifPlayer::play_frame(int* frame_delay) {
+bool GifPlayer::play_frame(int* frame_delay, bool draw) {
     bool sync = frame_delay == nullptr;
-    return gif.playFrame(sync, frame_delay) == 1;
+    begin_frame(draw);
+    if (replay != nullptr) {
+        return play_cached_frame(frame_delay);
+    }
+
+    int result;
+    if (frame_buffer != nullptr) {
+        // Decode asynchronously so the flush isn't held back by AnimatedGIF's sync delay
+        uint32_t start = millis();
+        int delay_ms = 0;
+        result = gif.playFrame(false, &delay_ms);
+        present_frame();
+        last_frame_stats.render_us = micros() - frame_start_us;
+        if (sync) {
+            uint32_t elapsed = millis() - start;
+            if (elapsed < (uint32_t)delay_ms) {
+                delay(delay_ms - elapsed);
+            }
+        } else {
+            *frame_delay = delay_ms;
+        }
+    } else {
+        result = gif.playFrame(sync, frame_delay);
+        present_frame();
+        last_frame_stats.render_us = micros() - frame_start_us;
+    }
+
+    end_frame(result, sync, frame_delay);
+    return result == 1;
+}
+
+GifPlayer::FrameProgress GifPlayer::play_frame_step(int* frame_delay, uint32_t budget_us, int max_lines, bool draw) {
+    if (decoder == nullptr) {
+        return play_frame(frame_delay, draw) ? FrameProgress::MORE_FRAMES : FrameProgress::LAST_FRAME;
+    }
+
+    uint32_t step_start = micros();
+    if (!frame_in_progress) {
+        begin_frame(draw);
+        if (replay != nullptr) {
+            // Replays only push pixels, so they are never split
+            return play_cached_frame(frame_delay) ? FrameProgress::MORE_FRAMES : FrameProgress::LAST_FRAME;
+        }
+        frame_in_progress = true;
+    }
+
+    bool done = decoder->resume(decode_frame, budget_us, max_lines);
+    if (!done) {
+        // render_us counts the slices only, not whatever the caller does in between
+        last_frame_stats.render_us += micros() - step_start;
+        return FrameProgress::IN_PROGRESS;
+    }
+    frame_in_progress = false;
+    present_frame();
+    last_frame_stats.render_us += micros() - step_start;
+
+    int result = decoder->result();
+    *frame_delay = decoder->delayMs();
+    end_frame(result, false, frame_delay);
+    return result == 1 ? FrameProgress::MORE_FRAMES : FrameProgress::LAST_FRAME;
+}
+
+int GifPlayer::decode_frame(int* delay_ms) {
+    return gif.playFrame(false, delay_ms);
+}
+
+void GifPlayer::begin_frame(bool draw) {
+    last_frame_stats = {};
+    frame_start_us = micros();
+
+    refresh_overlay();
+    if (replay != nullptr) {
+        return;
+    }
+    // Skipped frames only land in the buffer; the next drawn frame flushes their changes too
+    skip_draw = !draw && frame_buffer != nullptr;
+    overlay_touched = Overlay::active();
+    overlay_changes = Overlay::change_count();
+    frame_io_start = reader.getStats();
+    palette_cycles = 0;
+    push_cycles = 0;
+
+    select_draw_kernels();
+}
+
+// Get the decoded frame onto the panel
+void GifPlayer::present_frame() {
+    if (frame_buffer != nullptr) {
+        force_dirty = false;
+        if (!skip_draw) {
+            flush_frame_buffer();
+        }
+    } else {
+        // Other drawing (e.g. the log bar) may follow, so don't leave the last line in flight
+        wait_for_dma();
+    }
+    if (presenter != nullptr) {
+        presenter->drain();
+    }
+}
+
+void GifPlayer::end_frame(int result, bool sync, int* frame_delay) {
+    if (frame_cache.capturing()) {
+        // The log bar can come or go between the slices of a frame, after some of its lines were recorded blended
+        overlay_touched |= Overlay::active() || Overlay::change_count() != overlay_changes;
+        if (sync || skip_draw || overlay_touched) {
+            // The frame delay is unknown, or the recording would be missing skipped lines or include the overlay
+            frame_cache.abortCapture(false);
+        } else {
+            frame_cache.endFrame(*frame_delay);
+            if (result != 1) {
+                frame_cache.finishCapture();
+            }
+        }
+    }
+
+    BlockReader::Stats io_end = reader.getStats();
+    last_frame_stats.sd_bytes = io_end.sd_bytes - frame_io_start.sd_bytes;
+    last_frame_stats.seek_us = io_end.seek_us - frame_io_start.seek_us;
+    last_frame_stats.seeks = io_end.seeks - frame_io_start.seeks;
+
+    uint32_t cycles_per_us = ESP.getCpuFreqMHz();
+    last_frame_stats.palette_us = palette_cycles / cycles_per_us;
+    last_frame_stats.push_us = push_cycles / cycles_per_us;
+    // Whatever isn't conversion, transfer or waiting is AnimatedGIF parsing and LZW decoding
+    uint32_t accounted = last_frame_stats.palette_us + last_frame_stats.push_us + last_frame_stats.dma_wait_us;
+    last_frame_stats.decode_us = last_frame_stats.render_us > accounted ? last_frame_stats.render_us - accounted : 0;
+
+    // render_us includes AnimatedGIF's own delay for sync frames, so only async frames are representative
+    finish_frame(!sync || frame_buffer != nullptr);
+}
+
+void GifPlayer::finish_frame(bool record_perf) {
+    last_frame_stats.frames = 1;
+    total_stats.frames++;
+    total_stats.window_commands += last_frame_stats.window_commands;
+    total_stats.pushed_bytes += last_frame_stats.pushed_bytes;
+    total_stats.render_us += last_frame_stats.render_us;
+    total_stats.dma_wait_us += last_frame_stats.dma_wait_us;
+    total_stats.sd_bytes += last_frame_stats.sd_bytes;
+    total_stats.seek_us += last_frame_stats.seek_us;
+    total_stats.seeks += last_frame_stats.seeks;
+    total_stats.palette_us += last_frame_stats.palette_us;
+    total_stats.push_us += last_frame_stats.push_us;
+    total_stats.decode_us += last_frame_stats.decode_us;
+    total_stats.lines += last_frame_stats.lines;
+
+    if (!record_perf) {
+        return;
+    }
+    perf.add(PerfMetric::RENDER_US, last_frame_stats.render_us);
+    perf.add(PerfMetric::DECODE_US, last_frame_stats.decode_us);
+    perf.add(PerfMetric::PALETTE_US, last_frame_stats.palette_us);
+    perf.add(PerfMetric::PUSH_US, last_frame_stats.push_us);
+    perf.add(PerfMetric::DMA_WAIT_US, last_frame_stats.dma_wait_us);
+    perf.add(PerfMetric::SD_BYTES, last_frame_stats.sd_bytes);
+    perf.add(PerfMetric::SEEKS, last_frame_stats.seeks);
+    perf.add(PerfMetric::LINES, last_frame_stats.lines);
+    perf.add(PerfMetric::WINDOWS, last_frame_stats.window_commands);
+}
+
+bool GifPlayer::play_cached_frame(int* frame_delay) {
+    uint32_t render_start = micros();
+    const FrameCache::Frame& frame = replay->frames[replay_index++];
+    replay_frame(frame);
+    last_frame_stats.render_us = micros() - render_start;
+    last_frame_stats.push_us = last_frame_stats.render_us;
+    frame_cache.recordReplay(1, last_frame_stats.render_us);
+    finish_frame(true);
 
+    if (frame_delay == nullptr) {
+        delay(frame.delay_ms);
+    } else {
+        *frame_delay = frame.delay_ms;
+    }
+    return replay_index < replay->frames.size();
 }
 
 void GifPlayer::stop() {
+    if (replay != nullptr) {
+        replay = nullptr;
+        tft->endWrite();
+        return;
+    }
+    if (frame_in_progress) {
+        // The decode can only be left at the end of a frame, so run the rest of it without drawing
+        abort_frame = true;
+        while (!decoder->resume(decode_frame, UINT32_MAX, 0)) {
+        }
+        abort_frame = false;
+        frame_in_progress = false;
+        if (presenter != nullptr) {
+            presenter->drain();
+        }
+    }
+    // A gif stopped part way through was not fully recorded
+    frame_cache.abortCapture(false);
     gif.close();
+    wait_for_dma();
+    free_dma_lines();
     tft->endWrite();
     gif.reset();
 }
 
+// The probe decoder reads through a reader of its own
+void * GifPlayer::GIFProbeOpenFile(const char *fname, int32_t *pSize)
+{
+  if (probe_reader->open(SD_MMC, fname)) {
+    *pSize = probe_reader->size();
+    return (void *)probe_reader;
+  }
+  return NULL;
+}
+void GifPlayer::GIFProbeCloseFile(void *pHandle)
+{
+  static_cast<BlockReader *>(pHandle)->close();
+}
+
+bool GifPlayer::begin_probing() {
+    if (probe_gif != nullptr) {
+        return true;
+    }
+    // A decoder of its own keeps this off the playing gif's state, so the library can be scanned during playback.
+    // Both are large, and the scan runs next to whatever the boot gif allocated, so running out is handled.
+    probe_gif = new (std::nothrow) AnimatedGIF();
+    probe_reader = new (std::nothrow) BlockReader();
+    if (probe_gif == nullptr || probe_reader == nullptr || !probe_reader->setBlockSize(DEFAULT_READ_BLOCK_SIZE)) {
+        end_probing();
+        return false;
+    }
+    probe_gif->begin(BIG_ENDIAN_PIXELS);
+    return true;
+}
+
+void GifPlayer::end_probing() {
+    delete probe_gif;
+    delete probe_reader;
+    probe_gif = nullptr;
+    probe_reader = nullptr;
+}
+
+bool GifPlayer::probe(const char* path, GifInfo* info) {
+    if (probe_gif == nullptr) {
+        return false;
+    }
+    if (!probe_gif->open(path, GIFProbeOpenFile, GIFProbeCloseFile, GIFReadFile, GIFSeekFile, GIFDraw)) {
+        log_n("Could not probe gif %s", path);
+        // A file that opened but isn't a gif is left open by the decoder
+        probe_gif->close();
+        return false;
+    }
+    GIFINFO gif_info;
+    // getInfo walks every frame's headers but skips the image data, so nothing is decoded
+    bool ok = probe_gif->getInfo(&gif_info);
+    if (ok) {
+        info->width = probe_gif->getCanvasWidth();
+        info->height = probe_gif->getCanvasHeight();
+        info->frame_count = gif_info.iFrameCount;
+        info->duration_ms = gif_info.iDuration;
+    }
+    probe_gif->close();
+    return ok;
+}
+
 void GifPlayer::begin(TFT_eSPI* tft) {
     GifPlayer::tft = tft;
+    overlay_window.setTft(tft);
+}
+
+void GifPlayer::set_presenter(PresenterTask* presenter) {
+    GifPlayer::presenter = presenter;
+}
+
+void GifPlayer::set_prefetcher(PrefetchTask* prefetcher) {
+    GifPlayer::prefetcher = prefetcher;
+}
+
+void GifPlayer::prefetch(const char* path, size_t file_size) {
+    // load_cached() reads gifs the cache admits in one go, so opening them ahead would only read their head twice
+    bool from_cache = cache.enabled() && (cache.contains(path) || cache.admits(file_size));
+    if (prefetcher == nullptr || frame_cache.contains(path) || from_cache) {
+        return;
+    }
+    // Enough to seed every block of the read cache, whatever read_block_size set
+    prefetcher->request(path, READ_CACHE_BLOCKS * reader.blockSize());
+}
+
+void GifPlayer::set_decoder(DecodeTask* decoder) {
+    GifPlayer::decoder = decoder;
+}
+
+bool GifPlayer::set_dma(bool enabled) {
+    if (enabled && !tft->initDMA()) {
+        log_n("Failed to initialize DMA");
+        return false;
+    }
+    dma_enabled = enabled;
+    return true;
+}
+
+void GifPlayer::set_upscale(bool enabled) {
+    upscale = enabled;
+}
+
+bool GifPlayer::allocate_frame_buffer() {
+    if (frame_buffer == nullptr) {
+        frame_buffer = static_cast<uint16_t*>(malloc(DISPLAY_WIDTH * DISPLAY_HEIGHT * sizeof(uint16_t)));
+        if (frame_buffer == nullptr) {
+            log_n("Failed to allocate frame buffer");
+            return false;
+        }
+        memset(frame_buffer, 0, DISPLAY_WIDTH * DISPLAY_HEIGHT * sizeof(uint16_t));
+        mark_dirty(0, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1);
+    }
+    return true;
+}
+
+bool GifPlayer::set_frame_buffer(bool enabled) {
+    composite = false;
+    if (!enabled) {
+        free(frame_buffer);
+        frame_buffer = nullptr;
+        return true;
+    }
+    return allocate_frame_buffer();
+}
+
+bool GifPlayer::set_composite(bool enabled) {
+    if (!enabled) {
+        return set_frame_buffer(false);
+    }
+    composite = allocate_frame_buffer();
+    return composite;
+}
+
+bool GifPlayer::can_skip_draw() {
+    return frame_buffer != nullptr && replay == nullptr;
+}
+
+GifPlayer::FrameStats GifPlayer::get_last_frame_stats() {
+    return last_frame_stats;
+}
+
+GifPlayer::FrameStats GifPlayer::get_stats() {
+    return total_stats;
+}
+
+const PerfCounters& GifPlayer::get_perf() {
+    return perf;
+}
+
+BlockReader::Stats GifPlayer::get_io_stats() {
+    return reader.getStats();
+}
+
+void GifPlayer::set_cache(size_t budget_bytes, size_t max_file_bytes) {
+    cache.configure(budget_bytes, max_file_bytes);
+}
+
+GifCache::Stats GifPlayer::get_cache_stats() {
+    return cache.getStats();
+}
+
+void GifPlayer::set_frame_cache(size_t budget_bytes) {
+    frame_cache.configure(budget_bytes);
+}
 
-    dmaBuf = 0;
+FrameCache::Stats GifPlayer::get_frame_cache_stats() {
+    return frame_cache.getStats();
 }
 
-void GifPlayer::set_max_line(int l) {
-    max_line = l;
+bool GifPlayer::set_read_block_size(size_t block_size) {
+    return reader.setBlockSize(block_size);
 }
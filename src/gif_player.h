@@ -5,41 +5,259 @@
 #include <SD_MMC.h>
 #include <TFT_eSPI.h>
 
+#include "block_reader.h"
+#include "frame_cache.h"
+#include "gif_cache.h"
+#include "perf_counters.h"
+
 #define DISPLAY_WIDTH 240
 #define DISPLAY_HEIGHT 135
-// #define USE_DMA 1
 #define BUFFER_SIZE 256            // Optimum is >= GIF width or integral division of width
+#define MAX_UPSCALE 3              // Largest integer scale factor applied to small gifs
+#define DMA_LINE_BUFFERS 2         // TFT_eSPI keeps one transfer in flight, so two buffers let the next line be filled meanwhile
+
+class DecodeTask;
+class OverlayWindow;
+class PrefetchTask;
+class PresenterTask;
 
 class GifPlayer {
+    // Host benchmark of the draw kernels in lib/native_sim
+    friend class KernelBench;
+
+    public:
+        // SPI traffic counters, used to compare direct and frame buffer rendering
+        struct FrameStats {
+            uint32_t frames;
+            uint32_t window_commands;
+            uint32_t pushed_bytes;
+            uint32_t render_us;    // decode + draw time, excluding frame delays
+            uint32_t dma_wait_us;  // time spent blocked on a previous DMA transfer
+            uint32_t sd_bytes;     // bytes read from the card (cache misses only)
+            uint32_t seek_us;
+            uint32_t seeks;
+            uint32_t palette_us;   // palette conversion and back buffer updates
+            uint32_t push_us;      // handing pixels to the panel, the presenter or DMA
+            uint32_t decode_us;    // the remainder of render_us: gif parsing and LZW decoding
+            uint32_t lines;
+            uint32_t first_push_us; // from the start of play_frame to its first window; not summed in get_stats()
+        };
+
+        enum class FrameProgress : uint8_t {
+            IN_PROGRESS,  // call play_frame_step() again to carry on with the frame
+            MORE_FRAMES,  // the frame is done and another follows
+            LAST_FRAME,   // the frame is done and was the last, or decoding failed
+        };
+
+        struct GifInfo {
+            uint16_t width;
+            uint16_t height;
+            uint16_t frame_count;
+            uint32_t duration_ms;
+        };
+
     private:
         static AnimatedGIF gif;
         static TFT_eSPI* tft;
 
-        static File FSGifFile; // temp gif file holder
+        static BlockReader reader;
+        static GifCache cache;
+
+        // probe()'s own decoder and reader, kept off the playing gif's state and shared by every probe between
+        // begin_probing() and end_probing()
+        static AnimatedGIF* probe_gif;
+        static BlockReader* probe_reader;
+
+        // Decoded frames of looping gifs; replay is set while playing back from it
+        static FrameCache frame_cache;
+        static const FrameCache::Entry* replay;
+        static size_t replay_index;
 
-#ifdef USE_DMA
-        static uint16_t usTemp[2][BUFFER_SIZE]; // Global to support DMA use
-#else
-        static uint16_t usTemp[1][BUFFER_SIZE];    // Global to support DMA use
-#endif
-        static bool dmaBuf;
+        static uint16_t usTemp[BUFFER_SIZE];
+
+        // Line buffers in DMA-capable RAM, allocated per gif at start() when DMA is enabled
+        static bool dma_enabled;
+        static uint16_t* dma_lines[DMA_LINE_BUFFERS];
+        static int dma_line_width;
+        static int dma_index;
+
+        // When set, lines are queued to a presenter task on the other core instead of being pushed here
+        static PresenterTask* presenter;
+
+        // When set, files it has already opened and started reading are taken from it instead of the card
+        static PrefetchTask* prefetcher;
+
+        // When set, play_frame_step() decodes on it so a frame can be suspended between lines
+        static DecodeTask* decoder;
+        static bool frame_in_progress;
+        static bool abort_frame;
+
+        // Frame cache replays are streamed through this so lines under the overlay get blended
+        static OverlayWindow overlay_window;
 
         static int frame_delay;
-        static int max_line;
+
+        // Small gifs are drawn at an integer multiple of their size when upscale is set; scale is per gif
+        static bool upscale;
+        static int scale;
+
+        // Optional full-frame RGB565 back buffer; nullptr when drawing lines directly to the display
+        static uint16_t* frame_buffer;
+        static int dirty_x0, dirty_y0, dirty_x1, dirty_y1;
+        // The buffer is a shadow copy of the panel and changed spans are pushed line by line instead of per frame
+        static bool composite;
+        static bool force_dirty;
+        static bool skip_draw;
+        // Whether the overlay was shown or changed at any point of the frame being drawn, which blends it into pixels
+        // the frame cache would record
+        static bool overlay_touched;
+        static uint32_t overlay_changes;
+
+        static FrameStats last_frame_stats;
+        static FrameStats total_stats;
+        static uint32_t frame_start_us;
+        static BlockReader::Stats frame_io_start;
+        static uint32_t palette_cycles;
+        static uint32_t push_cycles;
+        static PerfCounters perf;
 
         static void * GIFOpenFile(const char *fname, int32_t *pSize);
         static void GIFCloseFile(void *pHandle);
         static int32_t GIFReadFile(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen);
         static int32_t GIFSeekFile(GIFFILE *pFile, int32_t iPosition);
         static void GIFDraw(GIFDRAW *pDraw);
+        static void * GIFProbeOpenFile(const char *fname, int32_t *pSize);
+        static void GIFProbeCloseFile(void *pHandle);
+
+        // Line drawing specialized per target and pixel mode, picked through kDrawKernels once per frame
+        enum DrawTarget : uint8_t {
+            DRAW_DIRECT,
+            DRAW_DMA,
+            DRAW_PRESENTER,
+            DRAW_BUFFER,
+            DRAW_BUFFER_REPAINT,
+            DRAW_TARGETS,
+        };
+        enum PixelMode : uint8_t {
+            PIXELS_OPAQUE,
+            PIXELS_TRANSPARENT,
+            PIXELS_RESTORE_BACKGROUND,
+            PIXEL_MODES,
+        };
+        typedef void (*DrawKernel)(GIFDRAW *pDraw, int iWidth, int y);
+        static const DrawKernel kDrawKernels[DRAW_TARGETS][PIXEL_MODES];
+        static const DrawKernel kScaledKernels[MAX_UPSCALE - 1][3][PIXEL_MODES];
+        static const DrawKernel* draw_kernels;
+        static int draw_width;
+        static int draw_scale;
+
+        template<DrawTarget TARGET, PixelMode MODE>
+        static void draw_direct_line(GIFDRAW *pDraw, int iWidth, int y);
+        template<PixelMode MODE, bool REPAINT>
+        static void draw_buffer_line(GIFDRAW *pDraw, int iWidth, int y);
+        template<int SCALE, DrawTarget TARGET, PixelMode MODE>
+        static void draw_scaled_line(GIFDRAW *pDraw, int iWidth, int y);
+        static void select_draw_kernels();
+
+        static void mark_dirty(int x0, int y0, int x1, int y1);
+        static void flush_frame_buffer();
+        static bool allocate_frame_buffer();
+
+        static void count_window();
+        static void present(int x, int y, int w, int h, const uint16_t* pixels);
+        static void present_rows(int x, int y, int w, int rows, const uint16_t* pixels);
+        static void wait_for_dma();
+        static void allocate_dma_lines(int width);
+        static void free_dma_lines();
+
+        static const uint8_t* load_cached(const char* path, size_t file_size, size_t* size);
+
+        static void capture(int x, int y, int w, int h, const uint16_t* pixels, int count);
+        static void replay_frame(const FrameCache::Frame& frame);
+        static void refresh_overlay();
+        static bool play_cached_frame(int* frame_delay);
+        static int decode_frame(int* delay_ms);
+        static void begin_frame(bool draw);
+        static void present_frame();
+        static void end_frame(int result, bool sync, int* frame_delay);
+        static void finish_frame(bool record_perf);
 
     public:
         static void begin(TFT_eSPI* tft);
 
-        static bool start(const char* path);
-        static bool play_frame(int* frame_delay);
+        // file_size is the size of the gif when known, e.g. from the gif index, or 0. Only gifs of a known size that
+        // the gif cache admits are loaded into it, so the others are opened once, straight from the card.
+        static bool start(const char* path, size_t file_size = 0);
+        // With draw false the frame is decoded but not presented, if can_skip_draw(); used to drop late frames
+        static bool play_frame(int* frame_delay, bool draw = true);
+        // Same, but returns IN_PROGRESS once the decode has run for budget_us or max_lines lines (0 for no limit),
+        // so the caller can do other work before calling again to continue the frame. Other drawing must wait until
+        // the frame is done, except for overlay changes, which are repainted with the next frame. Without a decoder
+        // (set_decoder()) the whole frame is played in one step.
+        static FrameProgress play_frame_step(int* frame_delay, uint32_t budget_us, int max_lines = 0, bool draw = true);
+        static bool is_frame_in_progress() { return frame_in_progress; }
+        // Finishes a frame in progress without drawing the rest of it
         static void stop();
 
-        static void set_max_line(int l);
+        // Allocates the decoder and reader that probe() uses, once for a batch of probes rather than per file.
+        // Returns false if there isn't the memory for them. end_probing() frees them again.
+        static bool begin_probing();
+        static void end_probing();
+        // Reads the size, frame count and loop duration of a gif without drawing it. Only between begin_probing()
+        // and end_probing(), which may run on another task while a gif is playing.
+        static bool probe(const char* path, GifInfo* info);
+
+        // Draw gifs that are at most half (or a third) of the display size at 2x (or 3x) with nearest-neighbour
+        // scaling, so quarter-size assets cover the screen. Takes effect at the next start().
+        static void set_upscale(bool enabled);
+
+        // Frames can only be skipped when a back buffer keeps the changes they would have drawn
+        static bool can_skip_draw();
+
+        // Render into a back buffer and flush only the changed bounding box once per frame.
+        // Returns false if the buffer could not be allocated (direct rendering stays active).
+        static bool set_frame_buffer(bool enabled);
+
+        // Keep a shadow copy of the frame and push each changed line span in one transfer, filling transparent
+        // pixels from the shadow rather than issuing a window per opaque run. Returns false if allocation failed.
+        static bool set_composite(bool enabled);
+
+        // Send opaque lines with DMA so the next line decodes while the previous one transfers.
+        // Takes effect at the next start(); returns false if DMA could not be initialized.
+        static bool set_dma(bool enabled);
+
+        // Split decode and SPI transfer across cores; pass nullptr to draw from the calling task again.
+        // Must only be changed while no gif is playing.
+        static void set_presenter(PresenterTask* presenter);
+
+        // Open gifs through prefetcher when it has them ready; pass nullptr to always open from the card
+        static void set_prefetcher(PrefetchTask* prefetcher);
+        // Have the prefetcher open path ahead of its start(), unless it will be played from RAM. file_size is as
+        // for start().
+        static void prefetch(const char* path, size_t file_size = 0);
+
+        // Decode play_frame_step() frames on decoder, best pinned to the caller's core; pass nullptr to play
+        // whole frames again. Must only be changed while no gif is playing.
+        static void set_decoder(DecodeTask* decoder);
+
+        // Stats for the most recently played frame, and totals since start()
+        static FrameStats get_last_frame_stats();
+        static FrameStats get_stats();
+
+        // Rolling per-frame counters across gifs; read from the task that plays gifs
+        static const PerfCounters& get_perf();
+
+        // Read cache counters for the current gif
+        static BlockReader::Stats get_io_stats();
+        static bool set_read_block_size(size_t block_size);
+
+        // Keep gifs up to max_file_bytes in RAM across plays, within budget_bytes total. A budget of 0 disables it.
+        static void set_cache(size_t budget_bytes, size_t max_file_bytes);
+        static GifCache::Stats get_cache_stats();
+
+        // Record decoded frames of gifs that fit in budget_bytes and replay later loops without decoding.
+        // A budget of 0 disables it.
+        static void set_frame_cache(size_t budget_bytes);
+        static FrameCache::Stats get_frame_cache_stats();
 
 };
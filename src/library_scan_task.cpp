@@ -0,0 +1,45 @@
+#include "library_scan_task.h"
+
+#include <SD_MMC.h>
+
+LibraryScanTask::LibraryScanTask(GifIndex& index, const char* mount_point, const uint8_t task_core) :
+        Task{"LibraryScan", 6144, 1, task_core}, index_(index), mount_point_(mount_point),
+        done_(xSemaphoreCreateBinary()) {
+    assert(done_ != NULL);
+}
+
+LibraryScanTask::~LibraryScanTask() {
+    if (done_ != NULL) {
+        vSemaphoreDelete(done_);
+    }
+}
+
+void LibraryScanTask::addLibrary(const char* dir, Playlist* playlist) {
+    assert(num_libraries_ < LIBRARY_SCAN_MAX_LIBRARIES);
+    libraries_[num_libraries_++] = {dir, playlist, 0};
+}
+
+void LibraryScanTask::run() {
+    start_millis_ = millis();
+    index_.load(SD_MMC, GIF_INDEX_PATH);
+    for (int i = 0; i < num_libraries_; i++) {
+        Library& library = libraries_[i];
+        uint32_t start = millis();
+        int probed = index_.refresh(mount_point_, library.dir);
+        library.count = index_.list(library.dir, *library.playlist);
+        log_n("Found %d GIF files in %s (%d probed, %u byte playlist) in %u ms", library.count, library.dir,
+            max(probed, 0), (unsigned)library.playlist->poolBytes(), millis() - start);
+    }
+    index_.save(SD_MMC, GIF_INDEX_PATH);
+    end_millis_ = millis();
+
+    xSemaphoreGive(done_);
+    vTaskDelete(NULL);
+}
+
+void LibraryScanTask::wait(int* counts) {
+    xSemaphoreTake(done_, portMAX_DELAY);
+    for (int i = 0; i < num_libraries_; i++) {
+        counts[i] = libraries_[i].count;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "gif_index.h"
+#include "playlist.h"
+#include "task.h"
+
+#define LIBRARY_SCAN_MAX_LIBRARIES 2
+
+// Loads the gif index, refreshes it from the card and lists each library folder into its playlist on the idle
+// core, so the card scan runs while the boot gif plays. Runs once; the index and playlists belong to the scan until
+// wait() returns.
+class LibraryScanTask : public Task<LibraryScanTask> {
+    friend class Task<LibraryScanTask>; // Allow base Task to invoke protected run()
+
+    public:
+        LibraryScanTask(GifIndex& index, const char* mount_point, const uint8_t task_core);
+        virtual ~LibraryScanTask();
+
+        // Adds a folder to scan into playlist; call before begin()
+        void addLibrary(const char* dir, Playlist* playlist);
+
+        // Blocks until the scan has finished. Returns the number of gifs found in each library, in the order added.
+        void wait(int* counts);
+
+        uint32_t startMillis() const { return start_millis_; }
+        uint32_t endMillis() const { return end_millis_; }
+
+    protected:
+        void run();
+
+    private:
+        struct Library {
+            const char* dir;
+            Playlist* playlist;
+            int count;
+        };
+
+        GifIndex& index_;
+        const char* mount_point_;
+        Library libraries_[LIBRARY_SCAN_MAX_LIBRARIES];
+        int num_libraries_ = 0;
+        SemaphoreHandle_t done_;
+        uint32_t start_millis_ = 0;
+        uint32_t end_millis_ = 0;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LOG_TASK_NAME_LENGTH 12
+#define LOG_MESSAGE_LENGTH 96
+
+enum class LogSeverity : uint8_t {
+    INFO,
+    WARNING,
+    ERROR,
+};
+
+struct LogRecord {
+    uint32_t millis;
+    LogSeverity severity;
+    char task[LOG_TASK_NAME_LENGTH];
+    char message[LOG_MESSAGE_LENGTH];  // truncated to fit, always NUL terminated
+};
+
+// Lock-free multi-producer ring of fixed-size log records that never allocates and never blocks a writer. Writers
+// claim a ticket and fill its slot in place; when the reader falls behind, the newest records overwrite the oldest.
+// Each slot carries a state word, ticket << 1 while published and (ticket << 1) | 1 while being written, which lets
+// the reader use a record in place and check afterwards that it wasn't overwritten meanwhile, like a seqlock. Has no
+// platform dependencies so it can be exercised on a host with several threads.
+template<size_t CAPACITY>
+class LogRing {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        // Writer: any task. Returns false if the record was dropped because its slot was still being written by a
+        // writer that is a whole ring behind, or already held a newer record.
+        bool write(LogSeverity severity, const char* task, const char* message, uint32_t millis) {
+            // Tickets start at 1 so that a state of 0 means the slot was never written
+            uint32_t ticket = head_.fetch_add(1, std::memory_order_relaxed) + 1;
+            Slot& slot = slots_[ticket & (CAPACITY - 1)];
+            uint32_t state = slot.state.load(std::memory_order_relaxed);
+            if ((state & 1) != 0 || (state >> 1) > ticket
+                    || !slot.state.compare_exchange_strong(state, (ticket << 1) | 1, std::memory_order_acquire)) {
+                drops_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (state != 0 && (state >> 1) >= read_.load(std::memory_order_relaxed)) {
+                overwrites_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            slot.record.millis = millis;
+            slot.record.severity = severity;
+            copyTruncated(slot.record.task, task, sizeof(slot.record.task));
+            copyTruncated(slot.record.message, message, sizeof(slot.record.message));
+            slot.state.store(ticket << 1, std::memory_order_release);
+            return true;
+        }
+
+        // Reader: returns the newest complete record without copying it, or nullptr if there is none. *token
+        // identifies it for unchanged() and markRead(); it increases with every newer record.
+        const LogRecord* newest(uint32_t* token) const {
+            uint32_t head = head_.load(std::memory_order_acquire);
+            for (uint32_t ticket = head; ticket > 0 && head - ticket < CAPACITY; ticket--) {
+                const Slot& slot = slots_[ticket & (CAPACITY - 1)];
+                if (slot.state.load(std::memory_order_acquire) == ticket << 1) {
+                    *token = ticket << 1;
+                    return &slot.record;
+                }
+            }
+            return nullptr;
+        }
+
+        // Reader: false if the record returned with token has since been overwritten, in which case whatever was
+        // read from it may be torn and should be discarded
+        bool unchanged(uint32_t token) const {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return slots_[(token >> 1) & (CAPACITY - 1)].state.load(std::memory_order_relaxed) == token;
+        }
+
+        // Reader: marks the record with token and every older one as read, so replacing them isn't an overwrite
+        void markRead(uint32_t token) {
+            read_.store((token >> 1) + 1, std::memory_order_relaxed);
+        }
+
+        // Records replaced before the reader got to them
+        uint32_t overwrites() const { return overwrites_.load(std::memory_order_relaxed); }
+        // Records not written at all
+        uint32_t drops() const { return drops_.load(std::memory_order_relaxed); }
+
+    private:
+        struct Slot {
+            std::atomic<uint32_t> state {0};
+            LogRecord record;
+        };
+
+        static void copyTruncated(char* dst, const char* src, size_t size) {
+            size_t i = 0;
+            for (; i < size - 1 && src[i] != '\0'; i++) {
+                dst[i] = src[i];
+            }
+            dst[i] = '\0';
+        }
+
+        Slot slots_[CAPACITY];
+        std::atomic<uint32_t> head_ {0};
+        std::atomic<uint32_t> read_ {0};
+        std::atomic<uint32_t> overwrites_ {0};
+        std::atomic<uint32_t> drops_ {0};
+};
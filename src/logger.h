@@ -1,9 +1,13 @@
 #pragma once
 
+#include "log_ring.h"
+
 class Logger {
     public:
         Logger() {};
         virtual ~Logger() {};
         virtual void log(const char* msg) = 0;
-    
+        // Loggers that don't keep severities log everything the same way
+        virtual void log(LogSeverity severity, const char* msg) { log(msg); }
+
 };
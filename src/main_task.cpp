@@ -9,6 +9,11 @@
 #include "semaphore_guard.h"
 
 #define TASK_NOTIFY_SET_CONFIG (1 << 0)
+#define TASK_NOTIFY_BUTTON_EDGE (1 << 1)
+
+#define BUTTON_CHECK_INTERVAL_MS 5   // While a button is changing; well inside AceButton's 20 ms debounce delay
+#define BUTTON_SETTLE_US 60000       // Quiet time after the last edge before the debouncer is left alone again
+#define IDLE_INTERVAL_MS 50          // Wifi, NTP and OTA housekeeping when no button is changing
 
 #define MDNS_NAME "switchOrnament"
 #define OTA_PASSWORD "hunter2"
@@ -32,14 +37,25 @@ MainTask::~MainTask() {
 void MainTask::run() {
     WiFi.mode(WIFI_STA);
 
-    AceButton left_button(PIN_LEFT_BUTTON, 1, BUTTON_ID_LEFT);
-    AceButton right_button(PIN_RIGHT_BUTTON, 1, BUTTON_ID_RIGHT);
-
-    pinMode(PIN_LEFT_BUTTON, INPUT_PULLUP);
-    pinMode(PIN_RIGHT_BUTTON, INPUT_PULLUP);
+    AceButton buttons[BUTTON_COUNT] = {
+        AceButton(PIN_LEFT_BUTTON, 1, BUTTON_ID_LEFT),
+        AceButton(PIN_RIGHT_BUTTON, 1, BUTTON_ID_RIGHT),
+    };
 
     ButtonConfig* config = ButtonConfig::getSystemButtonConfig();
     config->setIEventHandler(this);
+
+    // The debouncer only runs while a pin is changing; edges wake this task instead of it polling the pins
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        uint8_t pin = buttons[i].getPin();
+        pinMode(pin, INPUT_PULLUP);
+        button_inputs_[i].task = getHandle();
+        attachInterruptArg(digitalPinToInterrupt(pin), onButtonEdge, &button_inputs_[i], CHANGE);
+        // AceButton learns the idle level from its first debounce period of checks and reports nothing until then,
+        // so run it for one settle window from boot as if the pin had just changed; otherwise the first press only
+        // initializes it and is lost
+        button_inputs_[i].last_edge_us = micros();
+    }
     
     ArduinoOTA
         .onStart([this]() {
@@ -74,10 +90,12 @@ void MainTask::run() {
     ArduinoOTA.setPassword(OTA_PASSWORD);
 
     wl_status_t wifi_status = WL_DISCONNECTED;
+    bool buttons_changing = true;
     while (1) {
         uint32_t notify_value = 0;
-        if (xTaskNotifyWait(0, ULONG_MAX, &notify_value, 0) == pdTRUE) {
-            if (notify_value && TASK_NOTIFY_SET_CONFIG) {
+        uint32_t wait_ms = buttons_changing ? BUTTON_CHECK_INTERVAL_MS : IDLE_INTERVAL_MS;
+        if (xTaskNotifyWait(0, ULONG_MAX, &notify_value, pdMS_TO_TICKS(wait_ms)) == pdTRUE) {
+            if (notify_value & TASK_NOTIFY_SET_CONFIG) {
                 String wifi_ssid, wifi_password, timezone;
                 {
                     SemaphoreGuard lock(semaphore_);
@@ -140,10 +158,39 @@ void MainTask::run() {
         }
 
         ArduinoOTA.handle();
-        left_button.check();
-        right_button.check();
-        delay(1);
+        buttons_changing = checkButtons(buttons);
+    }
+}
+
+void IRAM_ATTR MainTask::onButtonEdge(void* arg) {
+    ButtonInput* input = static_cast<ButtonInput*>(arg);
+    uint32_t now = micros();
+    if (!input->edge_pending) {
+        // Later edges before the debounced event are bounce; the press or release happened at the first one
+        input->first_edge_us = now;
+        input->edge_pending = true;
+    }
+    input->last_edge_us = now;
+
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(input->task, TASK_NOTIFY_BUTTON_EDGE, eSetBits, &woken);
+    if (woken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+// Runs the debouncer of each button that changed recently. Returns true while any of them is still settling and
+// needs checking again soon; a new edge wakes the task through its notification either way.
+bool MainTask::checkButtons(AceButton* buttons) {
+    bool changing = false;
+    uint32_t now = micros();
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        if (now - button_inputs_[i].last_edge_us < BUTTON_SETTLE_US) {
+            buttons[i].check();
+            changing = true;
+        }
     }
+    return changing;
 }
 
 void MainTask::setConfig(const char* wifi_ssid, const char* wifi_password, const char* timezone) {
@@ -194,20 +241,23 @@ void MainTask::log(String message) {
 }
 
 void MainTask::registerEventQueue(QueueHandle_t queue) {
-    SemaphoreGuard lock(semaphore_);
-    event_queues_.push_back(queue);
+    bool subscribed = event_bus_.subscribe(queue);
+    assert("Too many event queues" && subscribed);
 }
 
 void MainTask::publishEvent(Event event) {
-    SemaphoreGuard lock(semaphore_);
-    for (QueueHandle_t queue : event_queues_) {
-        xQueueSend(queue, &event, 0);
-    }
+    event_bus_.publish(event);
 }
 
 void MainTask::handleEvent(AceButton* button, uint8_t event_type, uint8_t button_state) {
+    ButtonInput& input = button_inputs_[button->getId()];
+    // An edge racing with this leaves edge_pending clear; the next event then falls back to its last edge
+    uint32_t time_us = input.edge_pending ? input.first_edge_us : input.last_edge_us;
+    input.edge_pending = false;
+
     Event event = {
         .type = EventType::BUTTON,
+        .time_us = time_us,
         {
             .button = {
                 .button_id = button->getId(),
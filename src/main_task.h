@@ -5,6 +5,7 @@
 #include <AceButton.h>
 
 #include "event.h"
+#include "event_bus.h"
 #include "logger.h"
 #include "task.h"
 
@@ -31,8 +32,19 @@ class MainTask : public Task<MainTask>, public ace_button::IEventHandler {
         void log(const char* message);
         void log(String message);
 
+        // Edges seen by the pin interrupt, for waking the debouncer and stamping events
+        struct ButtonInput {
+            TaskHandle_t task;
+            volatile uint32_t first_edge_us;  // first edge since the last event, valid while edge_pending
+            volatile uint32_t last_edge_us;
+            volatile bool edge_pending;
+        };
+
+        static void IRAM_ATTR onButtonEdge(void* arg);
+        bool checkButtons(ace_button::AceButton* buttons);
+
         void publishEvent(Event event);
-        
+
         SemaphoreHandle_t semaphore_;
 
         String wifi_ssid_;
@@ -43,5 +55,6 @@ class MainTask : public Task<MainTask>, public ace_button::IEventHandler {
 
         Logger* logger_ = nullptr;
 
-        std::vector<QueueHandle_t> event_queues_;
+        ButtonInput button_inputs_[BUTTON_COUNT] = {};
+        EventBus event_bus_;
 };
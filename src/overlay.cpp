@@ -0,0 +1,161 @@
+#include "overlay.h"
+
+const uint16_t* Overlay::pixels = nullptr;
+int Overlay::top = DISPLAY_HEIGHT;
+int Overlay::height = 0;
+uint16_t Overlay::line[DISPLAY_WIDTH];
+
+int Overlay::changed_y0 = 0;
+int Overlay::changed_y1 = -1;
+uint32_t Overlay::changes = 0;
+
+// Halve each channel of a color in panel byte order
+static inline uint16_t dim(uint16_t color) {
+    color = (color >> 8) | (color << 8);
+    color = (color >> 1) & 0x7BEF;
+    return (color >> 8) | (color << 8);
+}
+
+void Overlay::mark_changed(int y0, int y1) {
+    if (changed_y1 < changed_y0) {
+        changed_y0 = y0;
+        changed_y1 = y1;
+        return;
+    }
+    changed_y0 = min(changed_y0, y0);
+    changed_y1 = max(changed_y1, y1);
+}
+
+void Overlay::set(const uint16_t* pixels, int y, int h) {
+    if (Overlay::pixels != nullptr) {
+        mark_changed(top, top + height - 1);
+    }
+    Overlay::pixels = pixels;
+    top = y;
+    height = h;
+    mark_changed(top, top + height - 1);
+    changes++;
+}
+
+void Overlay::clear() {
+    if (pixels == nullptr) {
+        return;
+    }
+    mark_changed(top, top + height - 1);
+    pixels = nullptr;
+    top = DISPLAY_HEIGHT;
+    height = 0;
+    changes++;
+}
+
+void Overlay::blend(int x, int y, int w, const uint16_t* src, uint16_t* dst) {
+    const uint16_t* over = &pixels[(y - top) * DISPLAY_WIDTH + x];
+    for (int i = 0; i < w; i++) {
+        dst[i] = over[i] == OVERLAY_KEY ? dim(src[i]) : over[i];
+    }
+}
+
+const uint16_t* Overlay::blend(int x, int y, int w, const uint16_t* src) {
+    blend(x, y, w, src, line);
+    return line;
+}
+
+bool Overlay::take_changed_lines(int* y0, int* y1) {
+    if (changed_y1 < changed_y0) {
+        return false;
+    }
+    *y0 = max(changed_y0, 0);
+    *y1 = min(changed_y1, DISPLAY_HEIGHT - 1);
+    changed_y0 = 0;
+    changed_y1 = -1;
+    return *y1 >= *y0;
+}
+
+void Overlay::paint(TFT_eSPI* tft, int y0, int y1) {
+    tft->setAddrWindow(0, y0, DISPLAY_WIDTH, y1 - y0 + 1);
+    for (int y = y0; y <= y1; y++) {
+        if (covers(y)) {
+            tft->pushPixels(&pixels[(y - top) * DISPLAY_WIDTH], DISPLAY_WIDTH);
+        } else {
+            tft->pushBlock(TFT_BLACK, DISPLAY_WIDTH);
+        }
+    }
+}
+
+void OverlayWindow::begin(int x, int y, int w, int h) {
+    x_ = x;
+    y_ = y;
+    width_ = w;
+    position_ = 0;
+    int first = max(y, 0);
+    int last = min(y + h, DISPLAY_HEIGHT) - 1;
+    while (first <= last && !Overlay::covers(first)) {
+        first++;
+    }
+    while (last >= first && !Overlay::covers(last)) {
+        last--;
+    }
+    if (first > last || x < 0 || x + w > DISPLAY_WIDTH) {
+        // Nothing to blend (windows hanging off the side are never recorded or stored)
+        covered_start_ = UINT32_MAX;
+        covered_end_ = UINT32_MAX;
+        return;
+    }
+    covered_start_ = (uint32_t)(first - y) * w;
+    covered_end_ = (uint32_t)(last + 1 - y) * w;
+}
+
+void OverlayWindow::pushPixels(const uint16_t* pixels, uint32_t n) {
+    while (n > 0) {
+        uint32_t k;
+        if (position_ >= covered_start_ && position_ < covered_end_) {
+            k = min(n, covered_end_ - position_);
+            pushCovered(pixels, 0, k);
+        } else {
+            k = min(n, position_ < covered_start_ ? covered_start_ - position_ : n);
+            tft_->pushPixels(pixels, k);
+            position_ += k;
+        }
+        pixels += k;
+        n -= k;
+    }
+}
+
+void OverlayWindow::pushBlock(uint16_t color, uint32_t n) {
+    while (n > 0) {
+        uint32_t k;
+        if (position_ >= covered_start_ && position_ < covered_end_) {
+            k = min(n, covered_end_ - position_);
+            pushCovered(nullptr, color, k);
+        } else {
+            k = min(n, position_ < covered_start_ ? covered_start_ - position_ : n);
+            // pushBlock takes a native color value rather than panel byte order
+            tft_->pushBlock((color << 8) | (color >> 8), k);
+            position_ += k;
+        }
+        n -= k;
+    }
+}
+
+// Gather n covered pixels (or n of color when pixels is nullptr), pushing each line as it completes
+void OverlayWindow::pushCovered(const uint16_t* pixels, uint16_t color, uint32_t n) {
+    while (n > 0) {
+        uint32_t column = position_ % width_;
+        uint32_t k = min(n, width_ - column);
+        if (pixels != nullptr) {
+            memcpy(&line_[column], pixels, k * sizeof(uint16_t));
+            pixels += k;
+        } else {
+            for (uint32_t i = 0; i < k; i++) {
+                line_[column + i] = color;
+            }
+        }
+        position_ += k;
+        n -= k;
+        if (column + k == (uint32_t)width_) {
+            int y = y_ + (position_ - 1) / width_;
+            Overlay::blend(x_, y, width_, line_, line_);
+            tft_->pushPixels(line_, width_);
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+#include "gif_player.h"
+
+#define OVERLAY_KEY 0x0000  // Overlay pixels of this color show the line underneath, dimmed
+
+// A strip of pixels shown over a band of lines of whatever is playing, such as the log bar. The players blend it
+// into each covered line just before pushing it, so the line still goes out in one transfer through the window it
+// was going to use anyway, and the panel never shows it without the overlay. Only changed from the task that plays
+// the frames, but possibly between the slices of a frame decoded in steps.
+class Overlay {
+    private:
+        static const uint16_t* pixels;  // DISPLAY_WIDTH per line, in panel byte order
+        static int top;
+        static int height;
+        static uint16_t line[DISPLAY_WIDTH];
+
+        // Lines set or removed since the players last repainted them
+        static int changed_y0;
+        static int changed_y1;
+
+        static void mark_changed(int y0, int y1);
+
+        // set() and clear() calls so far
+        static uint32_t changes;
+
+    public:
+        // Show DISPLAY_WIDTH x h pixels at lines y to y + h - 1. pixels must stay valid until clear() or the next
+        // set(); call set() again after changing them.
+        static void set(const uint16_t* pixels, int y, int h);
+        static void clear();
+
+        static bool active() { return pixels != nullptr; }
+        // Changes every time the overlay is set or cleared, so a player can tell whether it did during a frame
+        static uint32_t change_count() { return changes; }
+        static bool covers(int y) { return y >= top && y < top + height; }
+
+        // Blend w pixels of covered line y starting at x over src into dst, which may be src
+        static void blend(int x, int y, int w, const uint16_t* src, uint16_t* dst);
+        // Same, into a line buffer of the overlay's own that stays valid until the next call
+        static const uint16_t* blend(int x, int y, int w, const uint16_t* src);
+
+        // Lines a player has to repaint because the overlay was set or removed there. Returns false if none.
+        static bool take_changed_lines(int* y0, int* y1);
+        // Repaint lines y0 to y1 without knowing what the player last drew on them: the overlay over black where
+        // it is shown, and black where it was removed
+        static void paint(TFT_eSPI* tft, int y0, int y1);
+};
+
+// Streams the pixels of an address window to the panel in order, as recorded by the frame cache or stored in an
+// anim, gathering the lines the overlay covers into a line buffer so they are blended before going out.
+class OverlayWindow {
+    public:
+        explicit OverlayWindow(TFT_eSPI* tft = nullptr) : tft_(tft) {};
+
+        void setTft(TFT_eSPI* tft) { tft_ = tft; }
+
+        // Call after opening the address window on the panel
+        void begin(int x, int y, int w, int h);
+        void pushPixels(const uint16_t* pixels, uint32_t n);
+        // color is in panel byte order, like pushed pixels
+        void pushBlock(uint16_t color, uint32_t n);
+
+    private:
+        void pushCovered(const uint16_t* pixels, uint16_t color, uint32_t n);
+
+        TFT_eSPI* tft_;
+        int x_ = 0;
+        int y_ = 0;
+        int width_ = 0;
+        uint32_t position_ = 0;
+        // Pixel offsets in the window of the first covered line and of the line after the last
+        uint32_t covered_start_ = 0;
+        uint32_t covered_end_ = 0;
+        uint16_t line_[DISPLAY_WIDTH];
+};
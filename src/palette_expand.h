@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+
+// Word type allowed to alias the byte/halfword buffers it is used to access
+typedef uint32_t __attribute__((__may_alias__)) palette_word_t;
+
+// Translates count 8-bit palette indices into RGB565 values. Indices are fetched four at a time with aligned 32-bit
+// loads, and pairs of output pixels are written with 32-bit stores when dst allows it, cutting the number of memory
+// operations per pixel roughly in half compared to a byte-at-a-time loop. Assumes a little-endian CPU.
+static inline void palette_expand(uint16_t* dst, const uint8_t* src, const uint16_t* palette, int count) {
+    // Scalar head until the source is word aligned; the Xtensa core faults on unaligned word loads
+    while (count > 0 && ((uintptr_t)src & 3) != 0) {
+        *dst++ = palette[*src++];
+        count--;
+    }
+
+    const palette_word_t* src32 = reinterpret_cast<const palette_word_t*>(src);
+    if (((uintptr_t)dst & 3) == 0) {
+        palette_word_t* dst32 = reinterpret_cast<palette_word_t*>(dst);
+        while (count >= 8) {
+            uint32_t a = src32[0];
+            uint32_t b = src32[1];
+            dst32[0] = palette[a & 0xFF] | ((uint32_t)palette[(a >> 8) & 0xFF] << 16);
+            dst32[1] = palette[(a >> 16) & 0xFF] | ((uint32_t)palette[a >> 24] << 16);
+            dst32[2] = palette[b & 0xFF] | ((uint32_t)palette[(b >> 8) & 0xFF] << 16);
+            dst32[3] = palette[(b >> 16) & 0xFF] | ((uint32_t)palette[b >> 24] << 16);
+            src32 += 2;
+            dst32 += 4;
+            count -= 8;
+        }
+        dst = reinterpret_cast<uint16_t*>(dst32);
+    } else {
+        while (count >= 8) {
+            uint32_t a = src32[0];
+            uint32_t b = src32[1];
+            dst[0] = palette[a & 0xFF];
+            dst[1] = palette[(a >> 8) & 0xFF];
+            dst[2] = palette[(a >> 16) & 0xFF];
+            dst[3] = palette[a >> 24];
+            dst[4] = palette[b & 0xFF];
+            dst[5] = palette[(b >> 8) & 0xFF];
+            dst[6] = palette[(b >> 16) & 0xFF];
+            dst[7] = palette[b >> 24];
+            src32 += 2;
+            dst += 8;
+            count -= 8;
+        }
+    }
+    src = reinterpret_cast<const uint8_t*>(src32);
+
+    // Unrolled tail of up to 7 pixels
+    switch (count) {
+        case 7: dst[6] = palette[src[6]]; // fall through
+        case 6: dst[5] = palette[src[5]]; // fall through
+        case 5: dst[4] = palette[src[4]]; // fall through
+        case 4: dst[3] = palette[src[3]]; // fall through
+        case 3: dst[2] = palette[src[2]]; // fall through
+        case 2: dst[1] = palette[src[1]]; // fall through
+        case 1: dst[0] = palette[src[0]];
+    }
+}
+
+// Like palette_expand, but writes each pixel SCALE times in a row for nearest-neighbour upscaling. At 2x every
+// source pixel becomes exactly one 32-bit store when dst is word aligned.
+template<int SCALE>
+static inline void palette_expand_scaled(uint16_t* dst, const uint8_t* src, const uint16_t* palette, int count) {
+    if (SCALE == 2 && ((uintptr_t)dst & 3) == 0) {
+        palette_word_t* dst32 = reinterpret_cast<palette_word_t*>(dst);
+        for (int i = 0; i < count; i++) {
+            uint32_t color = palette[src[i]];
+            dst32[i] = color | (color << 16);
+        }
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        uint16_t color = palette[src[i]];
+        for (int j = 0; j < SCALE; j++) {
+            *dst++ = color;
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+
+// Min/avg/max/percentiles over the most recent WINDOW samples
+template<size_t WINDOW>
+class RollingStat {
+    public:
+        void add(uint32_t value) {
+            samples_[next_] = value;
+            next_ = (next_ + 1) % WINDOW;
+            if (count_ < WINDOW) {
+                count_++;
+            }
+        }
+
+        size_t count() const {
+            return count_;
+        }
+
+        uint32_t min() const {
+            return count_ == 0 ? 0 : *std::min_element(samples_, samples_ + count_);
+        }
+
+        uint32_t max() const {
+            return count_ == 0 ? 0 : *std::max_element(samples_, samples_ + count_);
+        }
+
+        uint32_t avg() const {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < count_; i++) {
+                sum += samples_[i];
+            }
+            return count_ == 0 ? 0 : sum / count_;
+        }
+
+        // Nearest-rank percentile; sorts a copy, so only call this when reporting
+        uint32_t percentile(uint8_t pct) const {
+            if (count_ == 0) {
+                return 0;
+            }
+            uint32_t sorted[WINDOW];
+            std::copy(samples_, samples_ + count_, sorted);
+            size_t rank = (count_ * pct + 99) / 100;
+            size_t index = rank > 0 ? rank - 1 : 0;
+            std::nth_element(sorted, sorted + index, sorted + count_);
+            return sorted[index];
+        }
+
+    private:
+        uint32_t samples_[WINDOW];
+        size_t next_ = 0;
+        size_t count_ = 0;
+};
+
+enum class PerfMetric : uint8_t {
+    RENDER_US,
+    DECODE_US,
+    PALETTE_US,
+    PUSH_US,
+    DMA_WAIT_US,
+    SD_BYTES,
+    SEEKS,
+    LINES,
+    WINDOWS,
+    COUNT,
+};
+
+// Rolling per-frame counters for the gif pipeline. Not synchronized: record and read from the same task.
+class PerfCounters {
+    public:
+        static const size_t kWindow = 128;
+
+        struct Summary {
+            uint32_t min;
+            uint32_t avg;
+            uint32_t max;
+            uint32_t p99;
+        };
+
+        void add(PerfMetric metric, uint32_t value) {
+            stats_[(size_t)metric].add(value);
+        }
+
+        Summary summary(PerfMetric metric) const {
+            const RollingStat<kWindow>& stat = stats_[(size_t)metric];
+            return {stat.min(), stat.avg(), stat.max(), stat.percentile(99)};
+        }
+
+        size_t samples() const {
+            return stats_[0].count();
+        }
+
+        static const char* name(PerfMetric metric) {
+            static const char* const names[] = {
+                "render_us",
+                "decode_us",
+                "palette_us",
+                "push_us",
+                "dma_wait_us",
+                "sd_bytes",
+                "seeks",
+                "lines",
+                "windows",
+            };
+            return names[(size_t)metric];
+        }
+
+    private:
+        RollingStat<kWindow> stats_[(size_t)PerfMetric::COUNT];
+};
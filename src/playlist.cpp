@@ -0,0 +1,50 @@
+#include "playlist.h"
+
+#include <Arduino.h>
+
+Playlist::~Playlist() {
+    release();
+}
+
+bool Playlist::reset(size_t pool_bytes, size_t max_entries) {
+    release();
+    if (pool_bytes > PLAYLIST_MAX_POOL_BYTES) {
+        log_n("Playlist pool of %u bytes exceeds 16-bit offsets", (unsigned)pool_bytes);
+        return false;
+    }
+    if (max_entries == 0) {
+        return true;
+    }
+    pool_ = static_cast<char*>(malloc(pool_bytes));
+    offsets_ = static_cast<uint16_t*>(malloc(max_entries * sizeof(uint16_t)));
+    if (pool_ == nullptr || offsets_ == nullptr) {
+        log_n("Failed to allocate playlist of %u paths", (unsigned)max_entries);
+        release();
+        return false;
+    }
+    pool_capacity_ = pool_bytes;
+    capacity_ = max_entries;
+    return true;
+}
+
+bool Playlist::add(const char* path) {
+    size_t len = strlen(path) + 1;
+    if (count_ == capacity_ || pool_used_ + len > pool_capacity_) {
+        return false;
+    }
+    memcpy(&pool_[pool_used_], path, len);
+    offsets_[count_++] = pool_used_;
+    pool_used_ += len;
+    return true;
+}
+
+void Playlist::release() {
+    free(pool_);
+    free(offsets_);
+    pool_ = nullptr;
+    offsets_ = nullptr;
+    pool_capacity_ = 0;
+    pool_used_ = 0;
+    capacity_ = 0;
+    count_ = 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PLAYLIST_MAX_POOL_BYTES 65535
+
+// Read-only list of file paths kept back to back in one string pool, addressed through a 16-bit offset table. The
+// pool and table are allocated once at their exact size, so a library of any size costs two allocations instead of
+// one per file. Returned paths stay valid until the playlist is reset.
+class Playlist {
+    public:
+        Playlist() {};
+        ~Playlist();
+        Playlist(Playlist const&)=delete;
+        Playlist& operator=(Playlist const&)=delete;
+
+        // Drops any previous contents and allocates room for max_entries paths totalling pool_bytes bytes,
+        // including their terminators. pool_bytes must not exceed PLAYLIST_MAX_POOL_BYTES.
+        bool reset(size_t pool_bytes, size_t max_entries);
+
+        // Returns false if the path doesn't fit in the remaining space
+        bool add(const char* path);
+
+        size_t size() const { return count_; }
+        const char* get(size_t index) const { return &pool_[offsets_[index]]; }
+        size_t poolBytes() const { return pool_used_; }
+
+    private:
+        void release();
+
+        char* pool_ = nullptr;
+        uint16_t* offsets_ = nullptr;
+        size_t pool_capacity_ = 0;
+        size_t pool_used_ = 0;
+        size_t capacity_ = 0;
+        size_t count_ = 0;
+};
@@ -0,0 +1,94 @@
+#include "prefetch_task.h"
+
+#include <SD_MMC.h>
+
+PrefetchTask::PrefetchTask(const uint8_t task_core) : Task{"Prefetch", 4096, 1, task_core}, state_(PrefetchState::IDLE) {
+}
+
+PrefetchTask::~PrefetchTask() {
+    free(head_);
+}
+
+void PrefetchTask::run() {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (state_.load(std::memory_order_acquire) != PrefetchState::REQUESTED) {
+            continue;
+        }
+
+        [[maybe_unused]] uint32_t start = millis();
+        head_len_ = 0;
+        file_ = SD_MMC.open(path_);
+        if (file_) {
+            int32_t n = file_.read(head_, min((int32_t)file_.size(), head_request_));
+            head_len_ = max(n, (int32_t)0);
+        }
+        log_d("Prefetched %d bytes of %s in %u ms", head_len_, path_, millis() - start);
+        state_.store(PrefetchState::READY, std::memory_order_release);
+    }
+}
+
+bool PrefetchTask::request(const char* path, int32_t head_bytes) {
+    waitWhileRequested();
+    discard();
+    if (head_bytes > head_size_) {
+        free(head_);
+        head_ = static_cast<uint8_t*>(malloc(head_bytes));
+        head_size_ = head_ != nullptr ? head_bytes : 0;
+        if (head_ == nullptr) {
+            log_n("Failed to allocate %d byte prefetch buffer", head_bytes);
+            return false;
+        }
+    }
+    head_request_ = head_bytes;
+    strlcpy(path_, path, sizeof(path_));
+    state_.store(PrefetchState::REQUESTED, std::memory_order_release);
+    xTaskNotifyGive(getHandle());
+    return true;
+}
+
+bool PrefetchTask::take(const char* path, BlockReader& reader) {
+    waitWhileRequested();
+    if (state_.load(std::memory_order_acquire) != PrefetchState::READY) {
+        return false;
+    }
+    bool taken = false;
+    if (file_ && strcmp(path, path_) == 0) {
+        taken = reader.adopt(SD_MMC, path_, file_, head_, head_len_);
+    }
+    discard();
+    return taken;
+}
+
+bool PrefetchTask::take(const char* path, File* file, uint8_t* head, size_t head_capacity, size_t* head_len) {
+    waitWhileRequested();
+    if (state_.load(std::memory_order_acquire) != PrefetchState::READY) {
+        return false;
+    }
+    bool taken = false;
+    if (file_ && strcmp(path, path_) == 0) {
+        size_t n = min((size_t)head_len_, head_capacity);
+        memcpy(head, head_, n);
+        // Whatever didn't fit is read again
+        taken = n == (size_t)head_len_ || file_.seek(n);
+        if (taken) {
+            *file = file_;
+            *head_len = n;
+        }
+    }
+    discard();
+    return taken;
+}
+
+void PrefetchTask::waitWhileRequested() {
+    // The prefetch is already under way, so waiting for it is no slower than starting over
+    while (state_.load(std::memory_order_acquire) == PrefetchState::REQUESTED) {
+        delay(1);
+    }
+}
+
+void PrefetchTask::discard() {
+    file_ = File();
+    head_len_ = 0;
+    state_.store(PrefetchState::IDLE, std::memory_order_release);
+}
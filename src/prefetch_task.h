@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include <atomic>
+
+#include "block_reader.h"
+#include "task.h"
+
+// Opens the next file to play, a gif or an .anim, and reads its first blocks on the idle core while the current one
+// is still on screen, so switching files doesn't wait on the card.
+class PrefetchTask : public Task<PrefetchTask> {
+    friend class Task<PrefetchTask>; // Allow base Task to invoke protected run()
+
+    public:
+        PrefetchTask(const uint8_t task_core);
+        virtual ~PrefetchTask();
+
+        // Start prefetching path, reading its first head_bytes, and drop any earlier prefetch that wasn't taken.
+        // For a gif, head_bytes should cover the reader's cache blocks, so the whole head can seed them. Returns
+        // false if no buffer could be allocated for that.
+        bool request(const char* path, int32_t head_bytes);
+
+        // Hand the prefetched file over to reader if it is path, first waiting for a prefetch in progress.
+        // Returns false if path wasn't prefetched, in which case the caller opens it itself.
+        bool take(const char* path, BlockReader& reader);
+        // Same, for a caller with a read buffer of its own: copies up to head_capacity bytes of the head into head
+        // and leaves file positioned after them
+        bool take(const char* path, File* file, uint8_t* head, size_t head_capacity, size_t* head_len);
+
+    protected:
+        void run();
+
+    private:
+        enum class PrefetchState : uint8_t {
+            IDLE,
+            REQUESTED,  // owned by the prefetch task until it moves to READY
+            READY,
+        };
+
+        void waitWhileRequested();
+        void discard();
+
+        std::atomic<PrefetchState> state_;
+        char path_[256];
+        File file_;
+        // Only reallocated when a request asks for more than it holds, which only happens if the block size grows
+        uint8_t* head_ = nullptr;
+        int32_t head_size_ = 0;
+        int32_t head_request_ = 0;
+        int32_t head_len_ = 0;
+};
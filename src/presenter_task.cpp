@@ -0,0 +1,51 @@
+#include "presenter_task.h"
+
+PresenterTask::PresenterTask(TFT_eSPI& tft, const uint8_t task_core) : Task{"Presenter", 4096, 2, task_core}, tft_(tft) {
+}
+
+void PresenterTask::run() {
+    while (1) {
+        PresentLine* line = ring_.peek();
+        if (line == nullptr) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        if (line->height > 0) {
+            tft_.setAddrWindow(line->x, line->y, line->width, line->height);
+        }
+        tft_.pushPixels(line->pixels, line->width);
+        ring_.release();
+
+        TaskHandle_t producer = waiting_producer_;
+        if (producer != nullptr) {
+            xTaskNotifyGive(producer);
+        }
+    }
+}
+
+PresentLine* PresenterTask::acquireLine() {
+    PresentLine* line;
+    while ((line = ring_.reserve()) == nullptr) {
+        waitForPresenter();
+    }
+    return line;
+}
+
+void PresenterTask::submitLine() {
+    ring_.commit();
+    xTaskNotifyGive(getHandle());
+}
+
+void PresenterTask::drain() {
+    while (!ring_.empty()) {
+        waitForPresenter();
+    }
+}
+
+void PresenterTask::waitForPresenter() {
+    waiting_producer_ = xTaskGetCurrentTaskHandle();
+    // The timeout covers a release that raced with setting waiting_producer_
+    ulTaskNotifyTake(pdTRUE, 1);
+    waiting_producer_ = nullptr;
+}
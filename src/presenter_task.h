@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+#include "gif_player.h"
+#include "spsc_ring.h"
+#include "task.h"
+
+#define PRESENT_RING_LINES 16
+
+struct PresentLine {
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    int16_t height; // > 0 opens a new address window of that many lines; 0 continues the current window
+    uint16_t pixels[DISPLAY_WIDTH];
+};
+
+// Drains palette-converted lines produced by the decoding task to the panel, so that decode and SPI transfer run
+// on different cores. The producer must hold the TFT write transaction (GifPlayer::start) while lines are queued.
+class PresenterTask : public Task<PresenterTask> {
+    friend class Task<PresenterTask>; // Allow base Task to invoke protected run()
+
+    public:
+        PresenterTask(TFT_eSPI& tft, const uint8_t task_core);
+        virtual ~PresenterTask() {};
+
+        // Producer side: returns a free line to fill, blocking while the ring is full
+        PresentLine* acquireLine();
+        void submitLine();
+
+        // Producer side: blocks until every submitted line has been pushed to the panel
+        void drain();
+
+    protected:
+        void run();
+
+    private:
+        void waitForPresenter();
+
+        TFT_eSPI& tft_;
+        SpscRing<PresentLine, PRESENT_RING_LINES> ring_;
+        volatile TaskHandle_t waiting_producer_ = nullptr;
+};
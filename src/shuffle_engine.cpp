@@ -0,0 +1,168 @@
+#include "shuffle_engine.h"
+
+// Murmur3 finalizer, used as the Feistel round function
+static uint32_t mix(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x85ebca6b;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35;
+    x ^= x >> 16;
+    return x;
+}
+
+void ShuffleEngine::reset(uint32_t size, PlaylistOrder order, uint32_t seed, uint8_t history,
+        uint8_t max_weight, WeightFunction weight, void* weight_context) {
+    size_ = size;
+    order_ = order;
+    random_state_ = seed != 0 ? seed : 1;
+    max_weight_ = max_weight > 0 ? max_weight : 1;
+    weight_ = weight;
+    weight_context_ = weight_context;
+
+    // A history as long as the library would leave nothing to pick
+    history_size_ = history < SHUFFLE_MAX_HISTORY ? history : SHUFFLE_MAX_HISTORY;
+    if (size_ > 0 && history_size_ > size_ - 1) {
+        history_size_ = size_ - 1;
+    }
+    history_count_ = 0;
+    history_next_ = 0;
+    deferred_count_ = 0;
+
+    slots_ = size_ * max_weight_;
+    half_bits_ = 1;
+    while (half_bits_ < 16 && ((uint64_t)1 << (2 * half_bits_)) < slots_) {
+        half_bits_++;
+    }
+    newPass();
+}
+
+uint32_t ShuffleEngine::next() {
+    if (order_ == PlaylistOrder::SEQUENTIAL) {
+        uint32_t index = position_;
+        position_ = (position_ + 1) % size_;
+        return index;
+    }
+
+    uint32_t index;
+    if (takeDeferred(&index)) {
+        return pick(index);
+    }
+
+    // Every slot is used at most once per pass, so skipped slots keep the cost amortized constant per pick
+    while (true) {
+        if (position_ >= slots_) {
+            newPass();
+        }
+        uint32_t slot = permute(position_++);
+        index = slot / max_weight_;
+        uint32_t copy = slot % max_weight_;
+        if (copy > 0) {
+            uint8_t weight = weight_ != nullptr ? weight_(index, weight_context_) : 1;
+            if (copy >= weight) {
+                continue;
+            }
+        }
+        if (recentlyPicked(index)) {
+            defer(index);
+            continue;
+        }
+        return pick(index);
+    }
+}
+
+// Takes the oldest deferred file that has left the history. Only one file leaves the history per pick, and it is
+// picked again at once if it was deferred, so every file still deferred after a pick is recent.
+bool ShuffleEngine::takeDeferred(uint32_t* index) {
+    for (uint8_t i = 0; i < deferred_count_; i++) {
+        if (recentlyPicked(deferred_[i])) {
+            continue;
+        }
+        *index = deferred_[i];
+        if (--deferred_copies_[i] == 0) {
+            deferred_count_--;
+            for (uint8_t j = i; j < deferred_count_; j++) {
+                deferred_[j] = deferred_[j + 1];
+                deferred_copies_[j] = deferred_copies_[j + 1];
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+void ShuffleEngine::defer(uint32_t index) {
+    for (uint8_t i = 0; i < deferred_count_; i++) {
+        if (deferred_[i] == index) {
+            // A weight the history leaves no room for can't be met; the file is just picked as often as it allows
+            if (deferred_copies_[i] < max_weight_) {
+                deferred_copies_[i]++;
+            }
+            return;
+        }
+    }
+    if (deferred_count_ < history_size_) {
+        deferred_[deferred_count_] = index;
+        deferred_copies_[deferred_count_] = 1;
+        deferred_count_++;
+    }
+}
+
+uint32_t ShuffleEngine::pick(uint32_t index) {
+    if (history_size_ > 0) {
+        history_[history_next_] = index;
+        history_next_ = (history_next_ + 1) % history_size_;
+        if (history_count_ < history_size_) {
+            history_count_++;
+        }
+    }
+    return index;
+}
+
+void ShuffleEngine::newPass() {
+    position_ = 0;
+    for (int i = 0; i < 4; i++) {
+        keys_[i] = nextRandom();
+    }
+}
+
+// Maps a position in the pass to a slot. The Feistel network permutes the whole power-of-4 domain; cycle walking
+// re-applies it until the value lands in [0, slots), which keeps it a permutation of the slots. The domain is less
+// than four times the slot count, so this takes under four rounds on average.
+uint32_t ShuffleEngine::permute(uint32_t slot) const {
+    uint32_t value = slot;
+    do {
+        value = feistel(value);
+    } while (value >= slots_);
+    return value;
+}
+
+uint32_t ShuffleEngine::feistel(uint32_t value) const {
+    uint32_t mask = (1u << half_bits_) - 1;
+    uint32_t left = value >> half_bits_;
+    uint32_t right = value & mask;
+    for (int i = 0; i < 4; i++) {
+        uint32_t next = left ^ (mix(right ^ keys_[i]) & mask);
+        left = right;
+        right = next;
+    }
+    return (left << half_bits_) | right;
+}
+
+// xorshift32; only needs to rekey passes, not be cryptographically strong
+uint32_t ShuffleEngine::nextRandom() {
+    uint32_t x = random_state_;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    random_state_ = x;
+    return x;
+}
+
+bool ShuffleEngine::recentlyPicked(uint32_t index) const {
+    for (uint8_t i = 0; i < history_count_; i++) {
+        if (history_[i] == index) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHUFFLE_MAX_HISTORY 16
+#define SHUFFLE_MAX_WEIGHT 8    // Largest weight the config may give a file; each pass has size * max_weight slots
+
+enum class PlaylistOrder : uint8_t {
+    SEQUENTIAL,
+    SHUFFLE,
+};
+
+// Picks playlist indices without repeats, in constant memory and constant time per pick regardless of library size.
+// Rather than materializing a Fisher-Yates permutation, each pass through the library walks a keyed Feistel
+// permutation of the indices, which visits every index exactly once in random order and is rekeyed for every pass.
+// Files may have integer weights: a file of weight w owns w of max_weight slots and is picked w times per pass. A
+// short history of recent picks keeps a file from repeating within that many picks, including across passes. A file
+// skipped for being recent is deferred and picked as soon as it leaves the history, so no pass loses a file.
+// Only uses the standard library so it can be exercised on a host.
+class ShuffleEngine {
+    public:
+        // Weight of a file in [1, max_weight]; values outside are clamped
+        typedef uint8_t (*WeightFunction)(uint32_t index, void* context);
+
+        ShuffleEngine() {};
+
+        // history is the number of most recent picks that may not repeat; it is capped below size
+        void reset(uint32_t size, PlaylistOrder order, uint32_t seed, uint8_t history = 8,
+                uint8_t max_weight = 1, WeightFunction weight = nullptr, void* weight_context = nullptr);
+
+        // Returns the next index to play; size must be non-zero
+        uint32_t next();
+
+        uint32_t size() const { return size_; }
+
+    private:
+        void newPass();
+        uint32_t permute(uint32_t slot) const;
+        uint32_t feistel(uint32_t value) const;
+        uint32_t nextRandom();
+        bool recentlyPicked(uint32_t index) const;
+        bool takeDeferred(uint32_t* index);
+        void defer(uint32_t index);
+        uint32_t pick(uint32_t index);
+
+        uint32_t size_ = 0;
+        PlaylistOrder order_ = PlaylistOrder::SEQUENTIAL;
+        uint8_t max_weight_ = 1;
+        WeightFunction weight_ = nullptr;
+        void* weight_context_ = nullptr;
+
+        uint32_t slots_ = 0;        // size * max_weight
+        uint32_t position_ = 0;     // slots consumed in the current pass
+        uint8_t half_bits_ = 0;     // the permutation domain is 2^(2 * half_bits) >= slots
+        uint32_t keys_[4] = {};
+        uint32_t random_state_ = 1;
+
+        uint32_t history_[SHUFFLE_MAX_HISTORY] = {};
+        uint8_t history_size_ = 0;
+        uint8_t history_count_ = 0;
+        uint8_t history_next_ = 0;
+
+        // Deferred files are all in the history, so there are never more of them than history entries
+        uint32_t deferred_[SHUFFLE_MAX_HISTORY] = {};
+        uint8_t deferred_copies_[SHUFFLE_MAX_HISTORY] = {};    // picks each deferred file is owed, up to its weight
+        uint8_t deferred_count_ = 0;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free single-producer/single-consumer ring of fixed-size slots. Slots are filled and drained in place to
+// avoid copies: the producer calls reserve()/commit() and the consumer calls peek()/release(). Only the producer
+// writes head_ and only the consumer writes tail_, so no locks are needed. Has no platform dependencies so it can
+// be exercised on a host with two threads.
+template<typename T, size_t CAPACITY>
+class SpscRing {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        // Producer: returns the next free slot, or nullptr if the ring is full
+        T* reserve() {
+            uint32_t head = head_.load(std::memory_order_relaxed);
+            if (head - tail_.load(std::memory_order_acquire) == CAPACITY) {
+                return nullptr;
+            }
+            return &slots_[head & (CAPACITY - 1)];
+        }
+
+        // Producer: publishes the slot returned by reserve()
+        void commit() {
+            head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // Consumer: returns the oldest published slot, or nullptr if the ring is empty
+        T* peek() {
+            uint32_t tail = tail_.load(std::memory_order_relaxed);
+            if (head_.load(std::memory_order_acquire) == tail) {
+                return nullptr;
+            }
+            return &slots_[tail & (CAPACITY - 1)];
+        }
+
+        // Consumer: hands the slot returned by peek() back to the producer
+        void release() {
+            tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool empty() const {
+            return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+        }
+
+        size_t size() const {
+            return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+        }
+
+    private:
+        T slots_[CAPACITY];
+        std::atomic<uint32_t> head_ {0};
+        std::atomic<uint32_t> tail_ {0};
+};
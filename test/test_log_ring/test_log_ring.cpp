@@ -0,0 +1,187 @@
+// Host tests for LogRing: pio test -e native -f test_log_ring
+
+#include <unity.h>
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "log_ring.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Every field of a record is derived from millis, so a record read while it was being rewritten shows up
+static bool writeRecord(LogRing<8>& ring, uint32_t writer, uint32_t sequence) {
+    uint32_t millis = (writer << 24) | sequence;
+    char task[LOG_TASK_NAME_LENGTH];
+    char message[LOG_MESSAGE_LENGTH];
+    snprintf(task, sizeof(task), "w%u", (unsigned)writer);
+    snprintf(message, sizeof(message), "%u %u", (unsigned)millis, (unsigned)~millis);
+    return ring.write(LogSeverity::INFO, task, message, millis);
+}
+
+static bool consistent(const LogRecord& record) {
+    char task[LOG_TASK_NAME_LENGTH];
+    unsigned millis, check;
+    snprintf(task, sizeof(task), "w%u", (unsigned)(record.millis >> 24));
+    return sscanf(record.message, "%u %u", &millis, &check) == 2 && millis == record.millis
+            && check == (uint32_t)~record.millis && strcmp(task, record.task) == 0;
+}
+
+static void test_empty_ring() {
+    LogRing<4> ring;
+    uint32_t token;
+    TEST_ASSERT_NULL(ring.newest(&token));
+    TEST_ASSERT_EQUAL(0, ring.overwrites());
+    TEST_ASSERT_EQUAL(0, ring.drops());
+}
+
+static void test_newest_and_truncation() {
+    LogRing<4> ring;
+    char long_message[LOG_MESSAGE_LENGTH * 2];
+    memset(long_message, 'x', sizeof(long_message) - 1);
+    long_message[sizeof(long_message) - 1] = '\0';
+    TEST_ASSERT_TRUE(ring.write(LogSeverity::WARNING, "a task name longer than fits", long_message, 5));
+
+    uint32_t token;
+    const LogRecord* record = ring.newest(&token);
+    TEST_ASSERT_NOT_NULL(record);
+    TEST_ASSERT_EQUAL(5, record->millis);
+    TEST_ASSERT_TRUE(record->severity == LogSeverity::WARNING);
+    TEST_ASSERT_EQUAL(LOG_TASK_NAME_LENGTH - 1, strlen(record->task));
+    TEST_ASSERT_EQUAL(LOG_MESSAGE_LENGTH - 1, strlen(record->message));
+    TEST_ASSERT_TRUE(ring.unchanged(token));
+
+    uint32_t newer;
+    TEST_ASSERT_TRUE(ring.write(LogSeverity::INFO, "main", "second", 6));
+    TEST_ASSERT_EQUAL(6, ring.newest(&newer)->millis);
+    TEST_ASSERT_TRUE(newer > token);
+}
+
+static void test_overwrites_count_unread_records() {
+    LogRing<4> ring;
+    for (uint32_t i = 0; i < 4 + 3; i++) {
+        TEST_ASSERT_TRUE(ring.write(LogSeverity::INFO, "main", "message", i));
+    }
+    TEST_ASSERT_EQUAL(3, ring.overwrites());
+
+    // Replacing records the reader has seen isn't an overwrite
+    uint32_t token;
+    ring.newest(&token);
+    ring.markRead(token);
+    for (uint32_t i = 0; i < 4; i++) {
+        ring.write(LogSeverity::INFO, "main", "message", i);
+    }
+    TEST_ASSERT_EQUAL(3, ring.overwrites());
+    ring.write(LogSeverity::INFO, "main", "message", 0);
+    TEST_ASSERT_EQUAL(4, ring.overwrites());
+    TEST_ASSERT_EQUAL(0, ring.drops());
+}
+
+static void test_unchanged_detects_reuse() {
+    LogRing<4> ring;
+    ring.write(LogSeverity::INFO, "main", "first", 0);
+    uint32_t token;
+    ring.newest(&token);
+    for (uint32_t i = 0; i < 3; i++) {
+        ring.write(LogSeverity::INFO, "main", "message", i);
+    }
+    TEST_ASSERT_TRUE(ring.unchanged(token));
+    ring.write(LogSeverity::INFO, "main", "message", 0);
+    TEST_ASSERT_FALSE(ring.unchanged(token));
+}
+
+// Runs writers racing each other, and optionally a reader, on a ring small enough that writers lap each other and
+// the reader constantly
+static void race(bool with_reader) {
+    LogRing<8> ring;
+    const uint32_t writers = 4;
+    const uint32_t count = 200000;
+
+    std::atomic<bool> done {false};
+    uint32_t accepted = 0;
+    uint32_t torn = 0;
+    std::thread reader([&]() {
+        while (with_reader && !done.load()) {
+            uint32_t token;
+            const LogRecord* record = ring.newest(&token);
+            if (record == nullptr) {
+                continue;
+            }
+            LogRecord copy;
+            memcpy(&copy, record, sizeof(copy));
+            if (!ring.unchanged(token)) {
+                continue;
+            }
+            accepted++;
+            torn += !consistent(copy);
+            ring.markRead(token);
+        }
+    });
+
+    std::vector<uint32_t> written(writers, 0);
+    std::vector<uint32_t> dropped(writers, 0);
+    std::vector<std::thread> threads;
+    for (uint32_t writer = 0; writer < writers; writer++) {
+        threads.emplace_back([&, writer]() {
+            for (uint32_t i = 0; i < count; i++) {
+                if (writeRecord(ring, writer, i)) {
+                    written[writer]++;
+                } else {
+                    dropped[writer]++;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    done.store(true);
+    reader.join();
+
+    uint32_t total_written = 0;
+    uint32_t total_dropped = 0;
+    for (uint32_t writer = 0; writer < writers; writer++) {
+        total_written += written[writer];
+        total_dropped += dropped[writer];
+    }
+    TEST_ASSERT_EQUAL(writers * count, total_written + total_dropped);
+    TEST_ASSERT_EQUAL(total_dropped, ring.drops());
+    // Every slot is claimed by some ticket, and the first record in a slot replaces nothing; with no reader every
+    // later one is an overwrite
+    if (with_reader) {
+        TEST_ASSERT_TRUE(ring.overwrites() <= total_written - 8);
+        TEST_ASSERT_TRUE(accepted > 0);
+        TEST_ASSERT_EQUAL(0, torn);
+    } else {
+        TEST_ASSERT_EQUAL(total_written - 8, ring.overwrites());
+    }
+
+    // The newest record once the writers are done is complete
+    uint32_t token;
+    const LogRecord* record = ring.newest(&token);
+    TEST_ASSERT_NOT_NULL(record);
+    TEST_ASSERT_TRUE(consistent(*record));
+}
+
+static void test_racing_writers() {
+    race(false);
+}
+
+static void test_racing_writers_and_reader() {
+    race(true);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_ring);
+    RUN_TEST(test_newest_and_truncation);
+    RUN_TEST(test_overwrites_count_unread_records);
+    RUN_TEST(test_unchanged_detects_reuse);
+    RUN_TEST(test_racing_writers);
+    RUN_TEST(test_racing_writers_and_reader);
+    return UNITY_END();
+}
@@ -0,0 +1,203 @@
+// Host tests for ShuffleEngine: pio test -e native -f test_shuffle_engine
+
+#include <unity.h>
+
+#include <vector>
+
+#include "shuffle_engine.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Not powers of two or four, so the Feistel permutation has to cycle-walk out of its larger domain
+static const uint32_t kSizes[] = {1, 2, 3, 5, 7, 10, 17, 100, 1000, 4097};
+
+static void test_shuffle_visits_every_file_once_per_pass() {
+    for (uint32_t size : kSizes) {
+        ShuffleEngine engine;
+        engine.reset(size, PlaylistOrder::SHUFFLE, 12345, 0);
+        for (int pass = 0; pass < 3; pass++) {
+            std::vector<int> picks(size, 0);
+            for (uint32_t i = 0; i < size; i++) {
+                uint32_t index = engine.next();
+                TEST_ASSERT_TRUE(index < size);
+                picks[index]++;
+            }
+            for (uint32_t index = 0; index < size; index++) {
+                TEST_ASSERT_EQUAL(1, picks[index]);
+            }
+        }
+    }
+}
+
+static void test_shuffle_history_prevents_repeats() {
+    const uint8_t history = 8;
+    for (uint32_t size : kSizes) {
+        ShuffleEngine engine;
+        engine.reset(size, PlaylistOrder::SHUFFLE, 777, history);
+        // The window is capped below the library size, or nothing could be picked
+        uint32_t window = size > history ? history : size - 1;
+        std::vector<uint32_t> recent;
+        std::vector<int> picks(size, 0);
+        for (uint32_t i = 0; i < size * 10; i++) {
+            uint32_t index = engine.next();
+            for (uint32_t previous : recent) {
+                TEST_ASSERT_TRUE(previous != index);
+            }
+            recent.push_back(index);
+            if (recent.size() > window) {
+                recent.erase(recent.begin());
+            }
+            picks[index]++;
+        }
+        // Files skipped for being recent are deferred, not dropped
+        for (uint32_t index = 0; index < size; index++) {
+            TEST_ASSERT_TRUE(picks[index] > 0);
+        }
+    }
+}
+
+// Deferred picks lag by at most the history, so over many passes no file falls behind its share. Dropping skipped
+// slots instead lets the counts drift apart by a random walk.
+static void test_history_keeps_every_file_in_every_pass() {
+    const int passes = 500;
+    for (uint32_t size : kSizes) {
+        for (uint8_t history : {(uint8_t)2, (uint8_t)8, (uint8_t)SHUFFLE_MAX_HISTORY}) {
+            ShuffleEngine engine;
+            engine.reset(size, PlaylistOrder::SHUFFLE, 31337, history);
+            std::vector<int> picks(size, 0);
+            for (uint32_t i = 0; i < size * passes; i++) {
+                picks[engine.next()]++;
+            }
+            for (uint32_t index = 0; index < size; index++) {
+                TEST_ASSERT_INT_WITHIN(1, passes, picks[index]);
+            }
+        }
+    }
+}
+
+static uint8_t weightOf(uint32_t index, void* context) {
+    return static_cast<const uint8_t*>(context)[index];
+}
+
+static void test_weights_set_picks_per_pass() {
+    // Includes an out of range weight, which counts as max_weight
+    static uint8_t weights[] = {1, 2, 3, 4, 1, 9};
+    const uint32_t size = sizeof(weights);
+    const uint8_t max_weight = 4;
+    const int passes = 200;
+    ShuffleEngine engine;
+    engine.reset(size, PlaylistOrder::SHUFFLE, 42, 0, max_weight, weightOf, weights);
+
+    uint32_t pass_length = 0;
+    for (uint8_t weight : weights) {
+        pass_length += weight < max_weight ? weight : max_weight;
+    }
+    std::vector<int> picks(size, 0);
+    for (uint32_t i = 0; i < pass_length * passes; i++) {
+        picks[engine.next()]++;
+    }
+    for (uint32_t index = 0; index < size; index++) {
+        uint8_t weight = weights[index] < max_weight ? weights[index] : max_weight;
+        TEST_ASSERT_EQUAL(weight * passes, picks[index]);
+    }
+}
+
+static void test_weights_with_history() {
+    static uint8_t weights[] = {1, 2, 3, 4, 1, 2, 1, 1, 3, 1};
+    const uint32_t size = sizeof(weights);
+    const uint8_t max_weight = 4;
+    // Short enough to leave room for every weight: a file can't be picked more than once per history + 1 picks
+    const uint8_t history = 2;
+    const int passes = 500;
+    ShuffleEngine engine;
+    engine.reset(size, PlaylistOrder::SHUFFLE, 99, history, max_weight, weightOf, weights);
+
+    uint32_t pass_length = 0;
+    for (uint8_t weight : weights) {
+        pass_length += weight;
+    }
+    std::vector<uint32_t> recent;
+    std::vector<int> picks(size, 0);
+    for (uint32_t i = 0; i < pass_length * passes; i++) {
+        uint32_t index = engine.next();
+        for (uint32_t previous : recent) {
+            TEST_ASSERT_TRUE(previous != index);
+        }
+        recent.push_back(index);
+        if (recent.size() > history) {
+            recent.erase(recent.begin());
+        }
+        picks[index]++;
+    }
+    for (uint32_t index = 0; index < size; index++) {
+        TEST_ASSERT_INT_WITHIN(weights[index], weights[index] * passes, picks[index]);
+    }
+}
+
+static void test_weights_ignore_copies_without_a_function() {
+    ShuffleEngine engine;
+    engine.reset(10, PlaylistOrder::SHUFFLE, 5, 0, 3);
+    std::vector<int> picks(10, 0);
+    for (int i = 0; i < 10 * 50; i++) {
+        picks[engine.next()]++;
+    }
+    for (int count : picks) {
+        TEST_ASSERT_EQUAL(50, count);
+    }
+}
+
+static void test_sequential_order() {
+    ShuffleEngine engine;
+    engine.reset(7, PlaylistOrder::SEQUENTIAL, 99, 8);
+    for (int pass = 0; pass < 3; pass++) {
+        for (uint32_t index = 0; index < 7; index++) {
+            TEST_ASSERT_EQUAL(index, engine.next());
+        }
+    }
+}
+
+static void test_shuffle_order() {
+    const uint32_t size = 100;
+    ShuffleEngine engine;
+    engine.reset(size, PlaylistOrder::SHUFFLE, 2021, 0);
+    std::vector<uint32_t> first, second;
+    for (uint32_t i = 0; i < size; i++) {
+        first.push_back(engine.next());
+    }
+    for (uint32_t i = 0; i < size; i++) {
+        second.push_back(engine.next());
+    }
+    uint32_t in_place = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        in_place += first[i] == i;
+    }
+    // Neither the identity order nor the same order again, as every pass is rekeyed
+    TEST_ASSERT_TRUE(in_place < size / 4);
+    TEST_ASSERT_TRUE(first != second);
+
+    // The seed picks the order, and the same seed repeats it
+    ShuffleEngine same, other;
+    same.reset(size, PlaylistOrder::SHUFFLE, 2021, 0);
+    other.reset(size, PlaylistOrder::SHUFFLE, 2022, 0);
+    std::vector<uint32_t> same_order, other_order;
+    for (uint32_t i = 0; i < size; i++) {
+        same_order.push_back(same.next());
+        other_order.push_back(other.next());
+    }
+    TEST_ASSERT_TRUE(same_order == first);
+    TEST_ASSERT_TRUE(other_order != first);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_shuffle_visits_every_file_once_per_pass);
+    RUN_TEST(test_shuffle_history_prevents_repeats);
+    RUN_TEST(test_history_keeps_every_file_in_every_pass);
+    RUN_TEST(test_weights_set_picks_per_pass);
+    RUN_TEST(test_weights_with_history);
+    RUN_TEST(test_weights_ignore_copies_without_a_function);
+    RUN_TEST(test_sequential_order);
+    RUN_TEST(test_shuffle_order);
+    return UNITY_END();
+}
@@ -0,0 +1,112 @@
+// Host tests for SpscRing: pio test -e native -f test_spsc_ring
+
+#include <unity.h>
+
+#include <thread>
+
+#include "spsc_ring.h"
+
+struct Item {
+    uint32_t sequence;
+    uint32_t check;  // ~sequence, so a slot read before it was fully written shows up
+};
+
+void setUp() {}
+void tearDown() {}
+
+static void test_empty_ring() {
+    SpscRing<Item, 4> ring;
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_EQUAL(0, ring.size());
+    TEST_ASSERT_NULL(ring.peek());
+    TEST_ASSERT_NOT_NULL(ring.reserve());
+    // Reserving without committing publishes nothing
+    TEST_ASSERT_NULL(ring.peek());
+}
+
+static void test_full_ring() {
+    SpscRing<Item, 4> ring;
+    for (uint32_t i = 0; i < 4; i++) {
+        Item* item = ring.reserve();
+        TEST_ASSERT_NOT_NULL(item);
+        item->sequence = i;
+        ring.commit();
+    }
+    TEST_ASSERT_EQUAL(4, ring.size());
+    TEST_ASSERT_NULL(ring.reserve());
+
+    // Releasing one slot frees exactly one
+    TEST_ASSERT_EQUAL(0, ring.peek()->sequence);
+    ring.release();
+    TEST_ASSERT_NOT_NULL(ring.reserve());
+    ring.commit();
+    TEST_ASSERT_NULL(ring.reserve());
+}
+
+static void test_wrap_around() {
+    SpscRing<Item, 4> ring;
+    uint32_t produced = 0;
+    uint32_t consumed = 0;
+    // Uneven batches move the head and tail through every slot index many times
+    for (int round = 0; round < 100; round++) {
+        int batch = 1 + round % 4;
+        for (int i = 0; i < batch; i++) {
+            Item* item = ring.reserve();
+            TEST_ASSERT_NOT_NULL(item);
+            item->sequence = produced++;
+            ring.commit();
+        }
+        while (Item* item = ring.peek()) {
+            TEST_ASSERT_EQUAL(consumed++, item->sequence);
+            ring.release();
+        }
+        TEST_ASSERT_TRUE(ring.empty());
+    }
+    TEST_ASSERT_EQUAL(produced, consumed);
+}
+
+static void test_two_threads() {
+    static SpscRing<Item, 4> ring;
+    const uint32_t count = 1000000;
+
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < count; i++) {
+            Item* item;
+            while ((item = ring.reserve()) == nullptr) {
+                std::this_thread::yield();
+            }
+            item->sequence = i;
+            item->check = ~i;
+            ring.commit();
+        }
+    });
+
+    uint32_t expected = 0;
+    uint32_t errors = 0;
+    while (expected < count) {
+        Item* item = ring.peek();
+        if (item == nullptr) {
+            std::this_thread::yield();
+            continue;
+        }
+        // Anything lost, duplicated, reordered or torn breaks the sequence
+        if (item->sequence != expected || item->check != ~expected) {
+            errors++;
+        }
+        expected++;
+        ring.release();
+    }
+    producer.join();
+
+    TEST_ASSERT_EQUAL(0, errors);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_ring);
+    RUN_TEST(test_full_ring);
+    RUN_TEST(test_wrap_around);
+    RUN_TEST(test_two_threads);
+    return UNITY_END();
+}
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""Convert gifs into the .anim format played by AnimPlayer (see src/anim_player.h).
+
+Each gif is composited frame by frame, cropped to the display like GifPlayer does, converted to RGB565 and
+delta-coded against the previous frame. Changed pixels are grouped into rectangles that are stored either as a
+solid fill or as literal pixels. The .anim file is written next to each gif, where DisplayTask will prefer it.
+
+Usage: gif2anim.py <gif or directory> [...]
+
+Requires Pillow (pip install Pillow).
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+DISPLAY_WIDTH = 240
+DISPLAY_HEIGHT = 135
+
+MAGIC = b'SOA1'
+FILL_FLAG = 0x8000
+
+# Unchanged pixels are sent anyway when the gap between two changed runs is shorter than a span header
+MERGE_GAP = 4
+# Minimum length of a run of one color within a line before it is split out as a fill span
+MIN_FILL_RUN = 16
+
+
+def rgb565(r, g, b):
+    return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3)
+
+
+def changed_runs(row, prev_row):
+    """Returns [x0, x1) runs of pixels that differ from the previous frame, merging short gaps."""
+    runs = []
+    x = 0
+    width = len(row)
+    while x < width:
+        if prev_row is not None and row[x] == prev_row[x]:
+            x += 1
+            continue
+        start = x
+        while x < width and (prev_row is None or row[x] != prev_row[x]):
+            x += 1
+        if runs and start - runs[-1][1] <= MERGE_GAP:
+            runs[-1][1] = x
+        else:
+            runs.append([start, x])
+    return [tuple(r) for r in runs]
+
+
+def changed_rects(frame, prev_frame):
+    """Groups changed runs into (x, y, w, h) rectangles, extending identical runs on consecutive rows."""
+    rects = []
+    open_rects = {}
+    for y, row in enumerate(frame):
+        runs = changed_runs(row, prev_frame[y] if prev_frame is not None else None)
+        next_open = {}
+        for run in runs:
+            rect = open_rects.pop(run, None)
+            if rect is None:
+                rect = [run[0], y, run[1] - run[0], 0]
+            rect[3] += 1
+            next_open[run] = rect
+        rects.extend(open_rects.values())
+        open_rects = next_open
+    rects.extend(open_rects.values())
+    rects.sort(key=lambda r: (r[1], r[0]))
+    return rects
+
+
+def encode_span(x, y, w, h, pixels):
+    if all(p == pixels[0] for p in pixels):
+        return struct.pack('<HHHH', x, y, w | FILL_FLAG, h) + struct.pack('>H', pixels[0])
+    return struct.pack('<HHHH', x, y, w, h) + struct.pack('>%dH' % len(pixels), *pixels)
+
+
+def encode_frame(frame, prev_frame, delay_ms):
+    spans = []
+    for x, y, w, h in changed_rects(frame, prev_frame):
+        if h > 1:
+            pixels = [p for row in frame[y:y + h] for p in row[x:x + w]]
+            spans.append(encode_span(x, y, w, h, pixels))
+            continue
+
+        # Single line: split long runs of one color out as fills
+        row = frame[y]
+        start = x
+        i = x
+        while i < x + w:
+            j = i
+            while j < x + w and row[j] == row[i]:
+                j += 1
+            if j - i >= MIN_FILL_RUN:
+                if i > start:
+                    spans.append(encode_span(start, y, i - start, 1, row[start:i]))
+                spans.append(encode_span(i, y, j - i, 1, row[i:j]))
+                start = j
+            i = j
+        if start < x + w:
+            spans.append(encode_span(start, y, x + w - start, 1, row[start:x + w]))
+
+    data = b''.join(spans)
+    return struct.pack('<HHI', min(delay_ms, 0xFFFF), len(spans), len(data)) + data
+
+
+def encode(frames, width, height):
+    """frames is a list of (rows, delay_ms), rows being lists of RGB565 values."""
+    out = [MAGIC, struct.pack('<HHHH', width, height, len(frames), 0)]
+    prev = None
+    for rows, delay_ms in frames:
+        out.append(encode_frame(rows, prev, delay_ms))
+        prev = rows
+    return b''.join(out)
+
+
+def load_gif(path):
+    from PIL import Image, ImageSequence
+
+    image = Image.open(path)
+    width = min(image.width, DISPLAY_WIDTH)
+    height = min(image.height, DISPLAY_HEIGHT)
+    frames = []
+    for frame in ImageSequence.Iterator(image):
+        delay_ms = frame.info.get('duration', 0)
+        rgb = frame.convert('RGB').crop((0, 0, width, height))
+        data = list(rgb.getdata())
+        rows = [[rgb565(*p) for p in data[y * width:(y + 1) * width]] for y in range(height)]
+        frames.append((rows, delay_ms))
+    return frames, width, height
+
+
+def convert(path):
+    frames, width, height = load_gif(path)
+    data = encode(frames, width, height)
+    out_path = os.path.splitext(path)[0] + '.anim'
+    with open(out_path, 'wb') as f:
+        f.write(data)
+    print('%s: %d frames, %d -> %d bytes' % (out_path, len(frames), os.path.getsize(path), len(data)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('paths', nargs='+', help='gif files or directories containing gifs')
+    args = parser.parse_args()
+
+    for path in args.paths:
+        if os.path.isdir(path):
+            for root, _, files in os.walk(path):
+                for name in sorted(files):
+                    if name.lower().endswith('.gif'):
+                        convert(os.path.join(root, name))
+        elif path.lower().endswith('.gif'):
+            convert(path)
+        else:
+            print('Skipping %s: not a gif' % path, file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
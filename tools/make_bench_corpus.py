@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""Generate the gif corpus used by the native benchmark (see bench/README.md).
+
+Each case stresses a different part of GifPlayer: full-screen frames, mostly transparent frames composited over a
+background, interlaced frames, a tiny looping gif, and a gif larger than the display that has to be cropped. The
+gifs are written by a small encoder here rather than an image library, so the frame rectangles, disposal, interlacing
+and transparency of every case are exactly as described and the output is identical on every run.
+
+Usage: make_bench_corpus.py [output directory]
+"""
+
+import argparse
+import math
+import os
+import struct
+
+DISPLAY_WIDTH = 240
+DISPLAY_HEIGHT = 135
+
+DISPOSE_NONE = 1
+TRANSPARENT = 255
+
+
+def palette():
+    """A 255 color ramp around the hue circle, plus the reserved transparent index."""
+    colors = []
+    for i in range(255):
+        h = i / 255.0 * 6
+        x = int(255 * (1 - abs(h % 2 - 1)))
+        r, g, b = [(255, x, 0), (x, 255, 0), (0, 255, x), (0, x, 255), (x, 0, 255), (255, 0, x)][int(h) % 6]
+        colors.append((r, g, b))
+    colors.append((0, 0, 0))
+    return colors
+
+
+def lzw_encode(pixels, min_code_size=8):
+    """Variable width LZW as used by gif, emitting a clear code whenever the 4096 entry table fills up."""
+    clear = 1 << min_code_size
+    end = clear + 1
+    out = bytearray()
+    bits = 0
+    bit_count = 0
+
+    def emit(code, width):
+        nonlocal bits, bit_count
+        bits |= code << bit_count
+        bit_count += width
+        while bit_count >= 8:
+            out.append(bits & 0xFF)
+            bits >>= 8
+            bit_count -= 8
+
+    def reset():
+        return {bytes([i]): i for i in range(clear)}, end + 1, min_code_size + 1
+
+    table, next_code, width = reset()
+    emit(clear, width)
+    prefix = b''
+    for p in pixels:
+        candidate = prefix + bytes([p])
+        if candidate in table:
+            prefix = candidate
+            continue
+        emit(table[prefix], width)
+        if next_code == 4096:
+            emit(clear, width)
+            table, next_code, width = reset()
+        else:
+            table[candidate] = next_code
+            if next_code == (1 << width) and width < 12:
+                width += 1
+            next_code += 1
+        prefix = bytes([p])
+    if prefix:
+        emit(table[prefix], width)
+    emit(end, width)
+    if bit_count > 0:
+        out.append(bits & 0xFF)
+    return bytes(out)
+
+
+def interlace_rows(rows):
+    """Reorders rows into the four gif interlace passes."""
+    order = []
+    for start, step in ((0, 8), (4, 8), (2, 4), (1, 2)):
+        order.extend(range(start, len(rows), step))
+    return [rows[y] for y in order]
+
+
+def write_gif(path, width, height, frames, delay_ms=40, interlaced=False, disposal=DISPOSE_NONE):
+    """frames is a list of (x, y, rows) tuples, where rows is a list of bytes of palette indices."""
+    data = bytearray(b'GIF89a')
+    data += struct.pack('<HHBBB', width, height, 0xF7, 0, 0)  # global 256 color table
+    for r, g, b in palette():
+        data += bytes((r, g, b))
+    data += b'\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00'  # loop forever
+    for x, y, rows in frames:
+        has_transparency = any(TRANSPARENT in row for row in rows)
+        packed = (disposal << 2) | (1 if has_transparency else 0)
+        data += struct.pack('<BBBBHBB', 0x21, 0xF9, 4, packed, delay_ms // 10, TRANSPARENT, 0)
+        data += struct.pack('<BHHHHB', 0x2C, x, y, len(rows[0]), len(rows), 0x40 if interlaced else 0)
+        if interlaced:
+            rows = interlace_rows(rows)
+        lzw = lzw_encode(b''.join(rows))
+        data.append(8)
+        for i in range(0, len(lzw), 255):
+            chunk = lzw[i:i + 255]
+            data.append(len(chunk))
+            data += chunk
+        data.append(0)
+    data.append(0x3B)
+    with open(path, 'wb') as f:
+        f.write(data)
+    print('%s: %dx%d, %d frames, %d bytes' % (path, width, height, len(frames), len(data)))
+
+
+def plasma(width, height, t, bands=48):
+    """Smooth moving color field, quantized into bands so it compresses like typical pixel art."""
+    rows = []
+    for y in range(height):
+        row = bytearray(width)
+        for x in range(width):
+            v = math.sin(x / 23.0 + t) + math.sin(y / 17.0 - t * 0.7) + math.sin((x + y) / 31.0 + t * 0.4)
+            band = int((v + 3) / 6 * bands) % bands
+            row[x] = band * 254 // bands
+        rows.append(bytes(row))
+    return rows
+
+
+def fullscreen():
+    return [(0, 0, plasma(DISPLAY_WIDTH, DISPLAY_HEIGHT, i * 0.3)) for i in range(12)]
+
+
+def sparse_transparent():
+    """A static background, then full-canvas frames that are transparent apart from a few moving sprites."""
+    frames = [(0, 0, plasma(DISPLAY_WIDTH, DISPLAY_HEIGHT, 0))]
+    for i in range(24):
+        rows = [bytearray([TRANSPARENT]) * DISPLAY_WIDTH for _ in range(DISPLAY_HEIGHT)]
+        for sprite in range(5):
+            cx = int((sprite * 53 + i * 7) % (DISPLAY_WIDTH - 12))
+            cy = int((sprite * 29 + i * 3) % (DISPLAY_HEIGHT - 12))
+            for y in range(12):
+                for x in range(12):
+                    if (x - 6) ** 2 + (y - 6) ** 2 < 30:
+                        rows[cy + y][cx + x] = (sprite * 50 + i * 4) % 254
+        frames.append((0, 0, [bytes(row) for row in rows]))
+    return frames
+
+
+def interlaced():
+    return [(0, 0, plasma(DISPLAY_WIDTH, DISPLAY_HEIGHT, 2 + i * 0.5, bands=96)) for i in range(6)]
+
+
+def tiny_loop():
+    return [(0, 0, plasma(32, 32, i * 0.8, bands=16)) for i in range(12)]
+
+
+def oversized_cropped():
+    """Larger than the display in both directions, with sub-rectangle frames straddling the crop edges."""
+    frames = [(0, 0, plasma(320, 240, 0))]
+    for i in range(12):
+        frames.append((180 + i * 4, 100 + i * 3, plasma(96, 64, i * 0.6, bands=24)))
+    return frames
+
+
+CASES = [
+    ('fullscreen.gif', DISPLAY_WIDTH, DISPLAY_HEIGHT, fullscreen, {}),
+    ('sparse_transparent.gif', DISPLAY_WIDTH, DISPLAY_HEIGHT, sparse_transparent, {}),
+    ('interlaced.gif', DISPLAY_WIDTH, DISPLAY_HEIGHT, interlaced, {'interlaced': True}),
+    ('tiny_loop.gif', 32, 32, tiny_loop, {'delay_ms': 20}),
+    ('oversized_cropped.gif', 320, 240, oversized_cropped, {}),
+]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('output', nargs='?', default=os.path.join(os.path.dirname(__file__), '..', 'bench', 'corpus'),
+                        help='directory to write the corpus to (default: bench/corpus)')
+    args = parser.parse_args()
+
+    os.makedirs(args.output, exist_ok=True)
+    for name, width, height, make_frames, options in CASES:
+        write_gif(os.path.join(args.output, name), width, height, make_frames(), **options)
+
+
+if __name__ == '__main__':
+    main()